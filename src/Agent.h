@@ -2,11 +2,15 @@
 #define AGENT_H
 
 #include <limits>
+#include <algorithm>
 
 #include "Concepts.h"
 #include "SourceAgent.h"
 #include "Channel.h"
 #include "LinearTrajectory.h"
+#include "Log.h"
+#include "Pool.h"
+#include "Numa.h"
 #include "deselbystd/random.h"
 
 
@@ -40,9 +44,17 @@
  
 //
 // Base class for all agents
-// 
+//
+// Agents are allocated from the engine's pools (see Pool), as they're made and deleted at a high
+// rate on many threads. A derived agent type can define its own operator new and delete to be
+// allocated some other way.
+//
+// Each agent has a home NUMA node, initially the node of the thread that constructed it, which is where its
+// memory is. With an executor that has a queue per node (see NumaThreadPool) the agent is stepped by workers on
+// its home node, so the callback fields, channels and agents it makes are on that node too. Changing the home
+// node (see setHomeNode) changes where the agent is stepped, but its memory isn't migrated.
 template<Environment ENV>
-class Agent : public SourceAgent<ENV> {
+class Agent : public SourceAgent<ENV>, public PoolAllocated {
 public:
     typedef ENV::SpaceTime  SpaceTime;
     typedef ENV::SpaceTime::Time       Time;
@@ -61,11 +73,20 @@ public:
 
     virtual ~Agent() {} // virtual so that we can delete agents on a callback queue.
 
+    // Whether this agent can be deleted at the end of the simulation on another thread, at the same time
+    // as other agents. The agents left at the end are deleted in turn on the main thread, except those
+    // that return true, which are deleted in parallel when there are enough of them (see
+    // CallbackQueue::deleteCallbackAgents). Override to return true for agents with many instances
+    // whose destructors touch nothing shared with other agents, other than their channels, which
+    // are closed atomically.
+    virtual bool hasThreadSafeDestructor() const { return false; }
+
     // needs to be virtual so we can delete an agent without knowing the derived type
 
     // Attaches a ChannelReader to this object.
     void attach(ChannelExecutor<ENV> &&inChan) {
-        if(this->timeToIntersection(inChan.getCallbackField()->asBlockingField()) < 0) throw(std::runtime_error("Attempt to attach channel to an agent's past"));
+        std::shared_ptr<CallbackField<ENV>> blockingQueue;
+        if(inChan.timeToNext(*this, blockingQueue) < 0) throw(std::runtime_error("Attempt to attach channel to an agent's past"));
         inChannels.push_back(std::move(inChan));
     }
 
@@ -89,19 +110,55 @@ public:
     void jumpTo(const SpaceTime &newPosition) {
         assert(this->position() < newPosition);
         this->updatePosition(newPosition);
+        ++nTrajectoryChanges;
     }
 
+    // The number of times this agent has left its trajectory, by jumping or
+    // by changing velocity in a lambda. Positions of future events computed on
+    // the trajectory stay valid until this changes.
+    uint64_t trajectoryChanges() const { return nTrajectoryChanges; }
+
+    // The NUMA node whose workers step this agent
+    size_t homeNode() const { return home; }
+
+    // Moves this agent to another NUMA node, e.g. when most of the agents it talks to are there.
+    // From its next step, it is stepped on that node, and what it then makes is allocated there.
+    // This doesn't migrate the agent's memory: the agent itself, and anything it made before, stay on the
+    // node they were allocated on, so are then read remotely. Should be called from this agent's lambdas.
+    void setHomeNode(size_t node) { home = node; }
+
+
+    // Calls the given function on this agent when its trajectory reaches the given lab time.
+    // Timers are held on the agent itself, so they need no channel and never
+    // cause other agents to block. Timers at the same lab time are called in the
+    // order they were set.
+    template<std::invocable LAMBDA>
+    void callAt(Time labTime, LAMBDA &&function) {
+        if(this->timeToIntersection(LabTimeField<SpaceTime>(labTime)) < 0) throw(std::runtime_error("Attempt to set a timer in an agent's past"));
+        timers.emplace_back(labTime, nTimersSet++, std::forward<LAMBDA>(function));
+        std::push_heap(timers.begin(), timers.end(), Timer::later);
+    }
+
+    // Calls the given function when this agent's trajectory reaches the lab time of the given position
+    // (for an agent that doesn't change velocity and schedules a position on its trajectory, this is that position).
+    template<std::invocable LAMBDA>
+    void callAt(const SpaceTime &position, LAMBDA &&function) {
+        callAt(position.labTime(), std::forward<LAMBDA>(function));
+    }
 
-    // Execute this objects lambdas until it blocks
-    void step() {
+
+    // Execute this objects lambdas until it blocks.
+    // Virtual so that a group of agents can be scheduled as one (see AgentGroup)
+    virtual void step() {
         Simulation<ENV>::currentThreadAgent = this; // set this to the active agent so all lambdas know where they are.
         std::shared_ptr<CallbackField<ENV>> blockingQueue;
         do {
             blockingQueue = executeNextLambda();
-        } while(!blockingQueue);
-        if(inChannels.empty()) {
-            std::cout << "Out of inCahnnels, deleting " << this << std::endl;
-            delete(this); return; // no more inChannels
+        } while(!blockingQueue && !isDying);
+        if(isDying) inChannels.clear();
+        if(isFinished()) {
+            Log::write<LogLevel::Debug>("Out of inChannels and timers, deleting ", this);
+            delete(this); return;
         }
         blockingQueue->push(this); // push ourselves onto the queue of the agent we're blocking on and return immediately
     }
@@ -110,7 +167,12 @@ public:
     // Kills this agent by deleting all inChannels.
     // This will signal the end of the current step
     // which will then delete this object.
-    void die() { inChannels.clear(); }
+    // The inChannels are deleted at the end of the current lambda, as it may
+    // belong to one of them.
+    void die() {
+        isDying = true;
+        timers.clear();
+    }
 
 
 
@@ -120,8 +182,23 @@ public:
     // This is the agent on which notionally runs the main thread that starts/ends the computation.
 //    static inline Agent<ENV>            mainThreadAgent = Agent<ENV>(Trajectory(-sqrt(std::numeric_limits<typename SpaceTime::Time>::max())));
 private:
+    friend class AgentGroup<ENV>;
+    friend class Checkpoint<ENV>;
+
+    struct Timer {
+        Time                    labTime;
+        uint64_t                id;         // order of setting, to break ties deterministically
+        std::function<void()>   call;
+
+        static bool later(const Timer &a, const Timer &b) { return a.labTime > b.labTime || (a.labTime == b.labTime && a.id > b.id); }
+    };
 
     std::vector<ChannelExecutor<ENV>>   inChannels;
+    std::vector<Timer>                  timers;         // min-heap on lab time
+    uint64_t                            nTimersSet = 0;
+    uint64_t                            nTrajectoryChanges = 0;
+    size_t                              home = Numa::currentNode();
+    bool                                isDying = false;
 
     // TODO: this need only be a callback field, could initially be the boundary (though this would be of a different type, damn)
 
@@ -135,6 +212,13 @@ private:
     // }
 
 
+    // Whether this agent can do nothing more, so should be deleted. An agent with no inChannels or
+    // timers is kept while the boundary is only paused (see Simulation::runUntil), as channels may
+    // be attached to it before the simulation resumes.
+    bool isFinished() const {
+        return inChannels.empty() && timers.empty() && (isDying || !Simulation<ENV>::isPaused);
+    }
+
     // finds the earliest channel and moves this to its intersection point,
     // detaching any closed channels as it goes.
     // If inChannels is empty, moves this to SpaceTime::TOP
@@ -150,14 +234,8 @@ private:
                 ++chanIt;
                 inChannels.pop_back();
             } else {
-                Time intersectTime;
                 std::shared_ptr<CallbackField<ENV>> pBlockingField;
-                if(chanIt->empty()) {
-                    pBlockingField = chanIt->getCallbackField();
-                    intersectTime = this->timeToIntersection(pBlockingField->asBlockingField());
-                } else {
-                    intersectTime = this->timeToIntersection(chanIt->asLambdaField());
-                }
+                Time intersectTime = chanIt->timeToNext(*this, pBlockingField);
                 if(intersectTime < earliestIntersectionTime) {
                     earliestIntersectionTime = intersectTime;
                     earliestChanIt = chanIt;
@@ -174,12 +252,32 @@ private:
                 ++chanIt;
             }
         }
+        bool timerIsEarliest = false;
+        if(!timers.empty()) {
+            Time timerTime = this->timeToIntersection(LabTimeField<SpaceTime>(timers.front().labTime));
+            if(timerTime < earliestIntersectionTime || (timerTime == earliestIntersectionTime &&
+                (earliestBlockingQueue || deselby::Random::nextDouble() < 1.0/(multiplicity+1)))) {
+                earliestIntersectionTime = timerTime;
+                earliestBlockingQueue.reset();
+                timerIsEarliest = true;
+            }
+        }
         if(earliestIntersectionTime > 0) {
             this->advanceBy(earliestIntersectionTime);
         }
-        if(earliestChanIt != inChannels.rend() && !earliestBlockingQueue) {
-            // found a lambda so execute it
-            earliestChanIt->executeNext(*this);
+        if(timerIsEarliest || (earliestChanIt != inChannels.rend() && !earliestBlockingQueue)) {
+            SpaceTime positionBefore = this->position();
+            Velocity<SpaceTime> velocityBefore = this->vel;
+            if(timerIsEarliest) {
+                std::pop_heap(timers.begin(), timers.end(), Timer::later);
+                std::function<void()> call = std::move(timers.back().call);
+                timers.pop_back();
+                call();
+            } else {
+                // found a lambda so execute it
+                earliestChanIt->executeNext(*this);
+            }
+            if(!(this->position() == positionBefore && this->vel == velocityBefore)) ++nTrajectoryChanges;
         }
         // Three outcomes: 
         //   - successfully executed: returns nullptr
@@ -0,0 +1,140 @@
+#ifndef AGENTGROUP_H
+#define AGENTGROUP_H
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <memory>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "Agent.h"
+
+// An AgentGroup schedules a set of co-located agents (e.g. the agents in a cell or the parts of a
+// composite object) as a single task. When the group is stepped, it runs its members in turn
+// until none of them can make progress. A member that is blocked on another member isn't pushed
+// onto the other's callback queue and resubmitted to the executor, it is just run again, in the
+// same task, once the other has moved. The group as a whole only blocks on agents outside the group,
+// or on the boundary.
+//
+// Members are ordinary agents and are run exactly when they would be if they were scheduled separately,
+// so the order of execution is unchanged. Agents outside the group send to, and block on, members as usual.
+//
+// Members should be created with add(), which takes the new agent off the scheduler.
+// Agents that members create are not in the group.
+template<Environment ENV>
+class AgentGroup : public Agent<ENV> {
+public:
+    AgentGroup() { }
+
+    ~AgentGroup() {
+        for(Agent<ENV> *member : members) delete(member);
+    }
+
+    // Creates a new member at the position of the current agent.
+    template<std::derived_from<Agent<ENV>> T, class... ARGS>
+    T &add(ARGS &&... args) {
+        T *member = new T(std::forward<ARGS>(args)...);
+        Simulation<ENV>::currentThreadAgent->pCallbackBuffer->remove(member);
+        members.push_back(member);
+        blockingQueues.emplace_back(); // runnable
+        return *member;
+    }
+
+    size_t nMembers() const { return members.size(); }
+
+    // Called back from any of the queues the group is waiting on. Only one thread runs the members at
+    // a time: a call that arrives while they are being run is counted, and they are run again afterwards.
+    void step() override {
+        if(nWakeups.fetch_add(1) != 0) return;
+        do {
+            --nRegistrations;
+            runMembers();
+            if(members.empty() && nRegistrations == 0) { // there can be no more calls
+                delete(this);
+                return;
+            }
+        } while(nWakeups.fetch_sub(1) != 1);
+    }
+
+protected:
+    // The group only refers weakly to the callback fields that members are blocked on, as an agent doesn't keep hold
+    // of a field once it's pushed onto it: an agent that's deleted without moving on deletes its field, which calls
+    // back the agents on it. A field that has gone, like one that has been triggered, no longer blocks its members.
+    std::vector<Agent<ENV> *>                           members;
+    std::vector<std::weak_ptr<CallbackField<ENV>>>      blockingQueues; // what each member is blocked on, or empty if runnable
+    std::vector<std::weak_ptr<CallbackField<ENV>>>      waitingOn;      // queues outside the group that this group is on
+    std::atomic<int>                                    nWakeups = 0;
+    int                                                 nRegistrations = 1; // number of queues this is on, including that of its creator
+
+    // Runs members until they are all blocked, then puts the group on the queues outside the group that they are blocked on.
+    void runMembers() {
+        do {
+            bool isProgressing = true;
+            while(isProgressing) {
+                isProgressing = false;
+                for(size_t i = 0; i < members.size(); ) {
+                    std::shared_ptr<CallbackField<ENV>> blockingQueue = blockingQueues[i].lock();
+                    if(blockingQueue && !blockingQueue->triggered()) {
+                        ++i;
+                        continue;
+                    }
+                    Agent<ENV> *member = members[i];
+                    Simulation<ENV>::currentThreadAgent = member;
+                    while(!(blockingQueue = member->executeNextLambda()) && !member->isDying) { }
+                    blockingQueues[i] = blockingQueue;
+                    blockingQueue.reset();
+                    if(member->isDying) member->inChannels.clear();
+                    if(member->isFinished()) {
+                        delete(member); // members blocked on this one find its field gone
+                        members[i] = members.back();
+                        members.pop_back();
+                        blockingQueues[i] = std::move(blockingQueues.back());
+                        blockingQueues.pop_back();
+                    } else {
+                        ++i;
+                    }
+                    isProgressing = true;
+                }
+            }
+            Simulation<ENV>::currentThreadAgent = this;
+            if(members.empty()) return;
+        } while(!waitOnExternalQueues());
+    }
+
+    // Puts this group on the callback queues outside the group that members are blocked on, if it isn't already.
+    // Returns false if a queue has gone since its member blocked on it, so that member should be run again.
+    // The boundary is only waited on when there's nothing else to wait on, as the
+    // agents on the boundary's queue are deleted at the end of the simulation.
+    bool waitOnExternalQueues() {
+        std::erase_if(waitingOn, [](std::weak_ptr<CallbackField<ENV>> &queue) {
+            std::shared_ptr<CallbackField<ENV>> lockedQueue = queue.lock();
+            return !lockedQueue || lockedQueue->triggered();
+        });
+        std::unordered_set<const CallbackField<ENV> *> memberFields;
+        for(Agent<ENV> *member : members) memberFields.insert(member->pCallbackBuffer.get());
+        const CallbackField<ENV> *boundaryQueue = Simulation<ENV>::mainThread.pCallbackBuffer.get();
+        bool isOnBoundary = false;
+        for(std::weak_ptr<CallbackField<ENV>> &blockingQueue : blockingQueues) {
+            std::shared_ptr<CallbackField<ENV>> queue = blockingQueue.lock();
+            if(!queue) return false;
+            if(memberFields.contains(queue.get())) continue;
+            if(queue.get() == boundaryQueue) {
+                isOnBoundary = true;
+            } else if(std::none_of(waitingOn.begin(), waitingOn.end(), [&queue](std::weak_ptr<CallbackField<ENV>> &waitedOn) { return waitedOn.lock() == queue; })) {
+                waitingOn.push_back(queue);
+                ++nRegistrations; // before the push, which may call back immediately
+                queue->push(this);
+            }
+        }
+        if(nRegistrations == 0) {
+            if(!isOnBoundary) throw(std::runtime_error("Agents in a group are blocked only on each other"));
+            ++nRegistrations;
+            Simulation<ENV>::mainThread.getCallbackField()->push(this);
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef AGENTPOPULATION_H
+#define AGENTPOPULATION_H
+
+#include <limits>
+#include <map>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "Agent.h"
+#include "Channel.h"
+#include "Velocity.h"
+#include "numerics.h"
+
+// An AgentPopulation holds a large number of identical, lightweight agents (members) in a single
+// agent, with the members' positions, velocities and state each stored in a column (a vector indexed
+// by member). A member is just an index, so needs no heap object, channels, callback queue or
+// vtable of its own.
+//
+// Members are stepped in batches: a member asks to be stepped at a lab time with wakeAt(), and
+// when the population reaches that time all the members that are ready are passed together to
+//     void stepMembers(std::span<const size_t> readyMembers)
+// on DERIVED, which can then run over the columns as a single loop. Before the call, the positions
+// of the ready members are moved along their trajectories to the current lab time (see advanceMembers).
+// Each distinct wake-up time costs one timer on the population, however many members share it.
+//
+// As far as the rest of the simulation is concerned, the population is a single agent, so
+// members send and receive lambdas at the population's position (see MemberChannel). This
+// suits members that are close together on the scale of the lambda field (e.g. the contents of
+// a cell) and whose positions are only of interest to each other.
+//
+// DERIVED is the derived population type, ENV the environment and COLUMNS the types of the
+// members' state, one column per type.
+template<class DERIVED, Environment ENV, class... COLUMNS>
+class AgentPopulation : public Agent<ENV> {
+public:
+    typedef ENV::SpaceTime              SpaceTime;
+    typedef ENV::SpaceTime::Time        Time;
+
+    static constexpr Time NEVER = std::numeric_limits<Time>::max();
+
+    // Adds a member with the given trajectory and state. Returns the member's index.
+    size_t addMember(SpaceTime position, Velocity<SpaceTime> velocity, COLUMNS... state) {
+        positions.push_back(std::move(position));
+        velocities.push_back(std::move(velocity));
+        wakeTimes.push_back(NEVER);
+        pushState(std::index_sequence_for<COLUMNS...>(), std::move(state)...);
+        return positions.size() - 1;
+    }
+
+    // reserve space for a given number of members
+    void reserve(size_t nMembers) {
+        positions.reserve(nMembers);
+        velocities.reserve(nMembers);
+        wakeTimes.reserve(nMembers);
+        std::apply([nMembers](auto &... column) { (column.reserve(nMembers), ...); }, state);
+    }
+
+    size_t nMembers() const { return positions.size(); }
+
+    // The I'th state column
+    template<size_t I> auto &column() { return std::get<I>(state); }
+    template<size_t I> const auto &column() const { return std::get<I>(state); }
+
+    // Steps a member when the population reaches the given lab time, replacing any earlier request.
+    void wakeAt(size_t member, Time labTime) {
+        wakeTimes[member] = labTime;
+        auto [batch, isNew] = schedule.try_emplace(labTime);
+        batch->second.push_back(member);
+        if(isNew) this->callAt(labTime, [this, labTime]() { stepBatch(labTime); });
+    }
+
+    // Cancels a member's wake-up.
+    void sleep(size_t member) { wakeTimes[member] = NEVER; }
+
+    // Moves the given members along their trajectories to a lab time.
+    // When time is integer, a member moves to the first point on its trajectory at or after the
+    // lab time, as it can only move by whole multiples of its velocity (see timeToIntersection).
+    void advanceMembers(std::span<const size_t> members, Time labTime) {
+        for(size_t member : members) {
+            SpaceTime &position = positions[member];
+            const Velocity<SpaceTime> &velocity = velocities[member];
+            if constexpr(std::integral<Time>) {
+                position = position + velocity * ceilDiv<Time>(labTime - position.labTime(), velocity.labTime());
+            } else {
+                position = position + velocity * ((labTime - position.labTime()) / velocity.labTime());
+            }
+        }
+    }
+
+    std::vector<SpaceTime>              positions;  // position of each member at the lab time it was last stepped
+    std::vector<Velocity<SpaceTime>>    velocities;
+
+protected:
+    std::tuple<std::vector<COLUMNS>...>     state;
+    std::vector<Time>                       wakeTimes;  // lab time of each member's next step, or NEVER
+    std::map<Time, std::vector<size_t>>     schedule;   // members by requested wake-up time, including requests since replaced
+    std::vector<size_t>                     ready;      // reused for each batch
+
+    template<size_t... I>
+    void pushState(std::index_sequence<I...>, COLUMNS &&... values) {
+        (std::get<I>(state).push_back(std::move(values)), ...);
+    }
+
+    void stepBatch(Time labTime) {
+        auto batch = schedule.find(labTime);
+        ready.clear();
+        for(size_t member : batch->second) {
+            if(wakeTimes[member] == labTime) { // otherwise rescheduled since, or already in this batch
+                wakeTimes[member] = NEVER;
+                ready.push_back(member);
+            }
+        }
+        schedule.erase(batch);
+        if(ready.empty()) return;
+        advanceMembers(ready, labTime);
+        static_cast<DERIVED *>(this)->stepMembers(std::span<const size_t>(ready));
+    }
+};
+
+
+// A channel to one member of an AgentPopulation. Lambdas are called as
+//     f(population, memberIndex)
+// when the population absorbs them, in the order they were sent.
+// Since each MemberChannel has its own buffer, a source that sends to many members of
+// the same population can instead send over a single Channel<POP>, with the member index captured.
+//
+// POP is the type of the population, which should be derived from AgentPopulation
+template<class POP>
+class MemberChannel {
+public:
+    typedef POP::Environment            Environment;
+    typedef Environment::LambdaField    LambdaField;
+
+    MemberChannel() { }
+
+    // create a new channel to a member of a local population
+    MemberChannel(CallbackChannel<Environment> &source, POP &population, size_t member, LambdaField field = Simulation<Environment>::lambdaField) :
+        channel(source, population, std::move(field)), member(member) { }
+
+    // use an existing channel to the population
+    MemberChannel(Channel<POP> &&channel, size_t member) : channel(std::move(channel)), member(member) { }
+
+    // returns false if the channel has been closed at either end
+    template<std::invocable<POP &, size_t> LAMBDA>
+    bool send(LAMBDA &&function) const {
+        return channel.send([member = member, f = std::forward<LAMBDA>(function)](POP &population) mutable {
+            f(population, member);
+        });
+    }
+
+    bool isOpen() const { return channel.isOpen(); }
+
+    size_t memberIndex() const { return member; }
+
+protected:
+    Channel<POP>    channel;
+    size_t          member = 0;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef BROADCASTCHANNEL_H
+#define BROADCASTCHANNEL_H
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "Concepts.h"
+#include "Channel.h"
+#include "LinearTrajectory.h"
+#include "UniformGrid.h"
+#include "MinkowskiSpace.h"
+#include "predeclarations.h"
+
+// The region of spacetime within a given spatial distance, in the lab frame, of a centre point.
+// As a field, this is non-negative inside the region.
+template<class SPACETIME>
+class SpatialBall {
+public:
+    typedef SPACETIME           SpaceTime;
+    typedef SPACETIME::Time     Time;
+
+    SpaceTime   centre;
+    Time        radius;
+
+    SpatialBall(SpaceTime centre, Time radius) : centre(std::move(centre)), radius(radius) { }
+
+    Time operator ()(const SpaceTime &x) const { return radius*radius - spatialNormSquared(x - centre); }
+};
+
+
+// A lambda that only executes on agents that absorb it inside a region of spacetime.
+// One of these is shared, unchanged, by every agent a lambda is broadcast to.
+template<class REGION, class LAMBDA>
+struct RegionalLambda {
+    REGION  region;
+    LAMBDA  function;
+};
+
+
+// A BroadcastChannel sends a single lambda from a source to all the members of a group of
+// agents that absorb it within a region of spacetime (e.g. a ball about the point of emission).
+// The lambda is captured once, in a shared, immutable payload, and each member's buffer
+// holds only a reference to it.
+//
+// Since a member must block on any agent that may send it a lambda, membership is explicit
+// (each member has a channel from the source). However, the source keeps a spatial index
+// of the positions at which it last saw each member so that a broadcast only sends to the
+// members that could absorb it inside the region. A member's position is updated whenever it
+// absorbs a broadcast. Any position on a member's trajectory bounds where it can be in the future,
+// so stale positions make the index less selective, but never wrong.
+//
+// This is not a single emission per region: each member still has its own channel, and a broadcast
+// costs one send, and one entry in a buffer, for each member that may absorb it in the region. What
+// is saved is the copying of the lambda and the sends to members that are too far away. Members
+// that receive everything the source sends are better served by a MulticastChannel, whose
+// targets read from one shared log.
+//
+// T is the type of the members, which should be derived from Agent<ENV>
+template<class T>
+class BroadcastChannel {
+public:
+    typedef T::SpaceTime                SpaceTime;
+    typedef SpaceTime::Time             Time;
+    typedef T::Environment              Environment;
+    typedef Environment::LambdaField    LambdaField;
+
+    // The cell width of the spatial index should be of the order of a typical broadcast radius.
+    BroadcastChannel(CallbackChannel<Environment> &source, Time cellWidth, LambdaField field = Simulation<Environment>::lambdaField) :
+        source(&source), lambdaField(std::move(field)), index(cellWidth) { }
+
+    BroadcastChannel(const BroadcastChannel<T> &) = delete;
+    BroadcastChannel(BroadcastChannel<T> &&) = default;
+
+    // Adds an agent at the same position as the source to the group that receives broadcasts.
+    void addMember(T &target) {
+        members.emplace_back(Channel<T>(*source, target, lambdaField), std::make_shared<LastSeen>(target.position()), target.position());
+        index.insert(members.size()-1, members.back().indexedPosition);
+        indexedTimes.insert(members.back().indexedPosition.labTime());
+    }
+
+    size_t size() const { return members.size(); }
+
+    // Sends a lambda that will be executed by every member that absorbs it within the given
+    // spatial distance (in the lab frame) of the source's current position.
+    // The lambda is called as const, since it is shared by all members.
+    // Returns the number of members it was sent to (a superset of those that will execute it).
+    //
+    // Pruning assumes the lambda field is isotropic in the lab frame (e.g. an InnerProdField, or a
+    // ShiftedField whose shift is a lab-time reaction time) so the latest absorption within the region
+    // is at its edge, which is found along the first spatial coordinate, std::get<1>. For other fields,
+    // broadcast to a REGION, which isn't pruned.
+    template<std::invocable<T &> LAMBDA>
+    size_t broadcast(Time radius, LAMBDA &&function) {
+        std::shared_ptr<CallbackField<Environment>> sourceField = source->getCallbackField();
+        const SpaceTime &origin = sourceField->asPosition();
+        auto payload = std::make_shared<const RegionalLambda<SpatialBall<SpaceTime>,std::decay_t<LAMBDA>>>(
+            SpatialBall<SpaceTime>(origin, radius), std::forward<LAMBDA>(function));
+
+        // latest lab time at which the lambda can be absorbed inside the region
+        SpaceTime edge = origin;
+        std::get<1>(edge) += radius;
+        Time probeTime = LinearTrajectory<SpaceTime>(edge).timeToIntersection(sourceField->translate(lambdaField));
+        if(probeTime == std::numeric_limits<Time>::max() || indexedTimes.empty()) return broadcastToAll(payload);
+        Time latestAbsorption = origin.labTime() + probeTime;
+
+        std::vector<size_t> candidates;
+        index.forEachNear(origin, radius + std::max(Time(0), latestAbsorption - *indexedTimes.begin()), [&candidates](size_t i) {
+            candidates.push_back(i);
+        });
+
+        size_t nSent = 0;
+        std::vector<size_t> closedMembers;
+        for(size_t i : candidates) {
+            updateIndex(i);
+            const SpaceTime &lastPosition = members[i].indexedPosition;
+            Time reach = radius + latestAbsorption - lastPosition.labTime(); // furthest the member can be from origin and still reach the region in time
+            if(lastPosition.labTime() > latestAbsorption || spatialNormSquared(lastPosition - origin) > reach*reach) continue;
+            if(sendTo(members[i], payload)) ++nSent; else closedMembers.push_back(i);
+        }
+        std::sort(closedMembers.begin(), closedMembers.end());
+        removeMembers(closedMembers);
+        return nSent;
+    }
+
+    // Sends a lambda that will be executed by every member that absorbs it at a point X
+    // where region(X) >= 0. Without a bound on the region, this is sent to all members.
+    template<class REGION, std::invocable<T &> LAMBDA> requires std::is_class_v<REGION> && Field<REGION>
+    size_t broadcast(const REGION &region, LAMBDA &&function) {
+        return broadcastToAll(std::make_shared<const RegionalLambda<REGION,std::decay_t<LAMBDA>>>(region, std::forward<LAMBDA>(function)));
+    }
+
+protected:
+    // Thread-safe record of where a member was when it last absorbed a broadcast
+    struct LastSeen {
+        std::mutex  mutex;
+        SpaceTime   position;
+
+        LastSeen(SpaceTime position) : position(std::move(position)) { }
+
+        void set(const SpaceTime &newPosition) {
+            std::lock_guard<std::mutex> lock(mutex);
+            position = newPosition;
+        }
+
+        SpaceTime get() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return position;
+        }
+    };
+
+    struct Member {
+        Channel<T>                  channel;
+        std::shared_ptr<LastSeen>   lastSeen;           // written by the member
+        SpaceTime                   indexedPosition;    // position of the member in the index
+    };
+
+    CallbackChannel<Environment> *  source;
+    const LambdaField               lambdaField;
+    std::vector<Member>             members;
+    UniformGrid<SpaceTime,size_t>   index;
+    std::multiset<Time>             indexedTimes;       // lab times of the indexed positions
+
+
+    template<class PAYLOAD>
+    size_t broadcastToAll(const std::shared_ptr<PAYLOAD> &payload) {
+        size_t nSent = 0;
+        std::vector<size_t> closedMembers;
+        for(size_t i=0; i<members.size(); ++i) {
+            if(sendTo(members[i], payload)) ++nSent; else closedMembers.push_back(i);
+        }
+        removeMembers(closedMembers);
+        return nSent;
+    }
+
+    template<class PAYLOAD>
+    static bool sendTo(Member &member, const std::shared_ptr<PAYLOAD> &payload) {
+        return member.channel.send([payload, lastSeen = member.lastSeen](T &target) {
+            lastSeen->set(target.position());
+            if(payload->region(target.position()) >= 0) payload->function(target);
+        });
+    }
+
+    // Move a member's entry in the index to the position it was last seen at.
+    void updateIndex(size_t i) {
+        Member &member = members[i];
+        SpaceTime lastPosition = member.lastSeen->get();
+        if(lastPosition.labTime() == member.indexedPosition.labTime()) return;
+        index.move(i, member.indexedPosition, lastPosition);
+        indexedTimes.erase(indexedTimes.find(member.indexedPosition.labTime()));
+        indexedTimes.insert(lastPosition.labTime());
+        member.indexedPosition = std::move(lastPosition);
+    }
+
+    // remove members whose channels are closed, given their indices in ascending order
+    void removeMembers(const std::vector<size_t> &indices) {
+        for(auto it = indices.rbegin(); it != indices.rend(); ++it) {
+            size_t i = *it;
+            size_t last = members.size() - 1;
+            index.erase(i, members[i].indexedPosition);
+            indexedTimes.erase(indexedTimes.find(members[i].indexedPosition.labTime()));
+            if(i != last) {
+                index.erase(last, members[last].indexedPosition);
+                index.insert(i, members[last].indexedPosition);
+                members[i] = std::move(members[last]);
+            }
+            members.pop_back();
+        }
+    }
+};
+
+#endif
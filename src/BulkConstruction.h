@@ -0,0 +1,107 @@
+#ifndef BULKCONSTRUCTION_H
+#define BULKCONSTRUCTION_H
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Agent.h"
+#include "Channel.h"
+#include "Simulation.h"
+#include "ThreadPool.h"
+
+// Builds large initial populations of agents, and the channels between them, in parallel.
+//
+// Constructing agents one at a time on the main thread pushes each onto the main thread's
+// callback queue as it is made, and making a channel attaches it to its target there and then,
+// so building a graph of millions of agents is bound to one core. Here, agents are
+// constructed on one thread per core, each of which makes them on an origin of its own,
+// and they're then handed to the constructing agent (usually the main thread) in one step,
+// in order of index. Channels are made from an edge list, with each thread attaching the channels
+// of a different set of targets.
+//
+// For example:
+//     std::vector<Node *> nodes = BulkConstruction<ENV>::makeAgents<Node>(nNodes, [](size_t i) {
+//         Node *node = new Node(i);
+//         node->jumpTo(startPosition(i));
+//         return node;
+//     });
+//     std::vector<Channel<Node>> channels = BulkConstruction<ENV>::makeChannels(nodes, nodes, edges);
+//     for(size_t e = 0; e < edges.size(); ++e) nodes[edges[e].first]->out.push_back(std::move(channels[e]));
+template<Environment ENV>
+class BulkConstruction {
+public:
+    typedef ENV::LambdaField                    LambdaField;
+    typedef std::pair<size_t, size_t>           Edge;   // (source index, target index)
+
+    static constexpr size_t MINPERTHREAD = 4096;
+
+    // Makes nAgents agents, calling make(i), which should construct agent i with new and return a pointer
+    // to it. The agents start at the position and velocity of the agent that's currently running on
+    // this thread, and become its callback agents just as if they'd been constructed here, in order of index.
+    // As make() is called on many threads, it should only touch the agent it's making.
+    template<std::derived_from<Agent<ENV>> T, class F>
+    static std::vector<T *> makeAgents(size_t nAgents, F &&make) {
+        std::vector<T *> agents(nAgents);
+        SourceAgent<ENV> &creator = *Simulation<ENV>::currentThreadAgent;
+        std::map<size_t, typename CallbackQueue<ENV>::AgentDeque> madeAgents; // by first index of each slice
+        std::mutex mutex;
+        try {
+            parallelFor(nAgents, MINPERTHREAD, [&](size_t begin, size_t end) {
+                SourceAgent<ENV> origin(creator);
+                Simulation<ENV>::currentThreadAgent = &origin;
+                size_t i = begin;
+                try {
+                    for(; i < end; ++i) agents[i] = make(i);
+                } catch(...) {
+                    // an agent whose constructor threw is still on the origin's queue, so only delete what make() returned
+                    Simulation<ENV>::currentThreadAgent = &creator;
+                    origin.pCallbackBuffer->takeAll();
+                    for(size_t j = begin; j < i; ++j) delete(agents[j]);
+                    throw;
+                }
+                Simulation<ENV>::currentThreadAgent = &creator;
+                std::lock_guard<std::mutex> lock(mutex);
+                madeAgents[begin] = origin.pCallbackBuffer->takeAll();
+            });
+        } catch(...) {
+            for(auto &[begin, slice] : madeAgents) for(Agent<ENV> *agent : slice) delete(agent);
+            throw;
+        }
+        for(auto &[begin, slice] : madeAgents) creator.pCallbackBuffer->pushAll(std::move(slice));
+        return agents;
+    }
+
+    // Makes a channel for each edge, from sources[edge.first] to targets[edge.second], and returns
+    // them in the order of the edges. Each target's channels are attached in the order of the edges,
+    // so the result is the same as making the channels one at a time.
+    // The edges can be any container with size() and an operator [] that returns an Edge.
+    template<class TARGET, std::derived_from<CallbackChannel<ENV>> SOURCE, class EDGES = std::vector<Edge>>
+    static std::vector<Channel<TARGET>> makeChannels(const std::vector<SOURCE *> &sources, const std::vector<TARGET *> &targets,
+                                                     const EDGES &edges, LambdaField field = Simulation<ENV>::lambdaField) {
+        // counting sort of the edges by target
+        std::vector<size_t> firstEdge(targets.size() + 1, 0);   // index into byTarget of each target's first edge
+        for(size_t e = 0; e < edges.size(); ++e) {
+            Edge edge = edges[e];
+            if(edge.first >= sources.size() || edge.second >= targets.size()) throw(std::runtime_error("Edge refers to an agent that doesn't exist"));
+            ++firstEdge[edge.second + 1];
+        }
+        for(size_t target = 0; target < targets.size(); ++target) firstEdge[target + 1] += firstEdge[target];
+        std::vector<size_t> byTarget(edges.size());
+        std::vector<size_t> nextEdge(firstEdge.begin(), firstEdge.end() - 1);
+        for(size_t e = 0; e < edges.size(); ++e) byTarget[nextEdge[Edge(edges[e]).second]++] = e;
+
+        std::vector<Channel<TARGET>> channels(edges.size());
+        parallelFor(targets.size(), MINPERTHREAD, [&](size_t begin, size_t end) {
+            for(size_t i = firstEdge[begin]; i < firstEdge[end]; ++i) {
+                Edge edge = edges[byTarget[i]];
+                channels[byTarget[i]] = Channel<TARGET>(*sources[edge.first], *targets[edge.second], field);
+            }
+        });
+        return channels;
+    }
+};
+
+#endif
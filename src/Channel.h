@@ -6,6 +6,8 @@
 #include <functional>
 #include <exception>
 #include <mutex>
+#include <atomic>
+#include <limits>
 
 #include "Concepts.h"
 #include "SpatialFunction.h"
@@ -14,22 +16,113 @@
 #include "SourceAgent.h"
 #include "predeclarations.h"
 #include "ShiftedField.h"
+#include "Pool.h"
 
-template<Environment ENV> 
-class ChannelBuffer : public ThreadSafeQueue<SpatialFunction<ENV, typename Simulation<ENV>::TranslatedLambdaField>> {
+// The reader end of a channel: the sequence of lambdas that a single target has yet to execute.
+// While the source is open, its position bounds where the lambdas still to come can be absorbed.
+// This is read by a ChannelExecutor, which may be reading any kind of buffer, so the buffer
+// executes its own front lambda and needn't store lambdas as type-erased Lambdas.
+template<Environment ENV>
+class ChannelBuffer : public PoolAllocated {
 public:
     typedef typename ENV::SpaceTime SpaceTime;
-protected:
-    ChannelBuffer(CallbackChannel<ENV> &source) : source(&source) { }
-
-    template<class T> requires std::same_as<typename T::Envoronment, ENV> friend class Channel; // only Channel can construct a new channel.
-public:
+    typedef typename ENV::LambdaField LambdaField;
+    typedef typename ENV::SpaceTime::Time Time;
+    typedef typename Simulation<ENV>::TranslatedLambdaField TranslatedLambdaField;
+    typedef SpatialFunction<ENV, TranslatedLambdaField> Lambda;
 
-    CallbackChannel<ENV> *              source = nullptr; // null if closed on either end
+    std::atomic<CallbackChannel<ENV> *> source = nullptr; // null if closed on either end
+    const LambdaField                   lambdaField;      // the field, relative to the source, of lambdas sent down this channel (only its runtime parameters, e.g. a ShiftedField's shift, can differ from the simulation's)
 
     ChannelBuffer(const ChannelBuffer<ENV> &other) = delete; // just don't copy channels
     ChannelBuffer(ChannelBuffer<ENV> &&) = delete; // just don't copy channels
 
+    virtual ~ChannelBuffer() { }
+
+    virtual bool empty() = 0;
+    virtual const TranslatedLambdaField &frontField() = 0;  // field in which the front lambda is absorbed
+    virtual void executeFront(Agent<ENV> &agent) = 0;       // execute the front lambda on the target
+    virtual void pop() = 0;
+    virtual void clear() = 0;   // discard all unread lambdas
+
+    // Writes the unread lambdas to a checkpoint (see Checkpoint). Returns false if they can't
+    // be written, as is the case for closures.
+    virtual bool writeMessages(std::ostream &) { return empty(); }
+
+    // Reads lambdas written by writeMessages() onto the end of the buffer.
+    virtual void readMessages(std::istream &) { }
+
+    // The time until the given agent reaches the next event on this channel. This is the
+    // absorption of the front lambda or, if there is none, the source's blocking field, in
+    // which case blockingQueue is set to the callback queue of the source.
+    // The blocking field is the lambda field translated to the source (see README for the
+    // conditions under which the lambda field is its own blocking field).
+    virtual Time timeToNext(const Agent<ENV> &agent, std::shared_ptr<CallbackField<ENV>> &blockingQueue) {
+        if(empty()) {
+            CallbackChannel<ENV> *currentSource = source.load();
+            if(currentSource == nullptr) { // closed since the reader checked, perhaps after sending
+                if(!empty()) return agent.timeToIntersection(frontField());
+                return std::numeric_limits<Time>::max();
+            }
+            blockingQueue = currentSource->getCallbackField();
+            return agent.timeToIntersection(blockingQueue->translate(lambdaField));
+        }
+        return agent.timeToIntersection(frontField());
+    }
+
+    // A channel is closed for the reader as soon as there can be no
+    // more calls on this channel.
+    virtual bool isClosed() { return source == nullptr && empty(); }
+
+    // Closes the reader's end. Whichever end closes last deletes the buffer.
+    virtual void closeReader() {
+        clear(); // delete any captured channels
+        source = nullptr; // signal reader closure
+        releaseEnd();
+    }
+
+    // Closes the writer's end.
+    virtual void closeWriter() {
+        source = nullptr;
+        releaseEnd();
+    }
+
+protected:
+    std::atomic<int> nOpenEnds = 2;
+
+    ChannelBuffer(CallbackChannel<ENV> &source, LambdaField field) : source(&source), lambdaField(std::move(field)) { }
+    ChannelBuffer(LambdaField field) : lambdaField(std::move(field)) { }
+
+    // The two ends may close concurrently (e.g. when agents are deleted in parallel
+    // at the end of a simulation) so the count, not source, decides who deletes.
+    void releaseEnd() {
+        if(nOpenEnds.fetch_sub(1, std::memory_order_acq_rel) == 1) delete(this);
+    }
+};
+
+
+// The buffer of a one-to-one Channel, which holds the lambdas themselves.
+template<Environment ENV> 
+class QueueChannelBuffer : public ChannelBuffer<ENV>, protected ThreadSafeQueue<typename ChannelBuffer<ENV>::Lambda, PoolAllocator<typename ChannelBuffer<ENV>::Lambda>> {
+public:
+    typedef ChannelBuffer<ENV>::Lambda                  Lambda;
+    typedef ChannelBuffer<ENV>::LambdaField             LambdaField;
+    typedef ChannelBuffer<ENV>::TranslatedLambdaField   TranslatedLambdaField;
+    typedef ThreadSafeQueue<Lambda, PoolAllocator<Lambda>> Queue;
+protected:
+    QueueChannelBuffer(CallbackChannel<ENV> &source, LambdaField field) : ChannelBuffer<ENV>(source, std::move(field)) { }
+
+    template<class T> requires std::same_as<typename T::Envoronment, ENV> friend class Channel; // only Channel can construct a new channel.
+    template<class T> friend class FanIn;
+public:
+    using Queue::emplace;
+
+    bool empty() override { return Queue::empty(); }
+    Lambda &front() { return Queue::front(); }
+    const TranslatedLambdaField &frontField() override { return front().asField(); }
+    void executeFront(Agent<ENV> &agent) override { front()(agent); }
+    void pop() override { Queue::pop(); }
+    void clear() override { Queue::clear(); }
 };
 
 
@@ -49,27 +142,23 @@ public:
         throw(std::runtime_error("Don't try to copy construct an ChannelReader. Use std::move instead"));
     };
 
-    ChannelExecutor(ChannelExecutor<ENV> &&moveFrom) : buffer(moveFrom.buffer) {
+    ChannelExecutor(ChannelExecutor<ENV> &&moveFrom) noexcept : buffer(moveFrom.buffer) {
         moveFrom.buffer = nullptr;
     }
 
     ~ChannelExecutor() {
-        if(buffer != nullptr) {
-            if(buffer->source == nullptr) {
-                delete(buffer);
-            } else {
-                buffer->clear(); // delete any captured channels
-                buffer->source = nullptr; // signal reader closure
-            }
-        }
+        if(buffer != nullptr) buffer->closeReader();
     }
 
     // Could type-delete by making this into a std::function at construction (and separating position and function into two buffers)
+    // The lambda may attach new channels to the agent, which may move this executor,
+    // so we hold on to the buffer rather than this.
     inline bool executeNext(Agent<ENV> &agent) const {
-        if(buffer == nullptr) return false;
-        if(buffer->empty()) return (buffer->source == nullptr);
-        buffer->front()(agent); // do execution
-        buffer->pop();
+        ChannelBuffer<ENV> *executingBuffer = buffer;
+        if(executingBuffer == nullptr) return false;
+        if(executingBuffer->empty()) return (executingBuffer->source == nullptr);
+        executingBuffer->executeFront(agent); // do execution
+        executingBuffer->pop();
         return true;
     }
 
@@ -80,9 +169,12 @@ public:
         return true;
     }
 
-    ChannelExecutor &operator=(ChannelExecutor<ENV> &&moveFrom) {
-        buffer = moveFrom.buffer;
-        moveFrom.buffer = nullptr;
+    ChannelExecutor &operator=(ChannelExecutor<ENV> &&moveFrom) noexcept {
+        if(&moveFrom != this) {
+            if(buffer != nullptr) buffer->closeReader();
+            buffer = moveFrom.buffer;
+            moveFrom.buffer = nullptr;
+        }
         return *this;
     }
 
@@ -100,7 +192,13 @@ public:
 
     // A channel is closed for the reader as soon as there can be no
     // more calls on this channel.
-    bool isClosed() const { return buffer->source == nullptr && empty(); }
+    bool isClosed() const { return buffer->isClosed(); }
+
+    // see ChannelBuffer::timeToNext
+    Time timeToNext(const Agent<ENV> &agent, std::shared_ptr<CallbackField<ENV>> &blockingQueue) const {
+        assert(buffer != nullptr);
+        return buffer->timeToNext(agent, blockingQueue);
+    }
 
     // inline void pushCallback(Time callAfterLabTime, Agent<ENV> *agentToCallback) {
     //     assert(buffer != nullptr);
@@ -109,19 +207,6 @@ public:
     // }
 
 
-    // A non-empty Channel has a lambda field which is the field on the front lambda
-    const auto &asLambdaField() {
-        assert(buffer != nullptr);
-        assert(!buffer->empty());
-        return buffer->front().asField();
-    }
-
-    // A Channel has a blocking field defined by the channel source
-    std::shared_ptr<CallbackField<ENV>> getCallbackField() {
-        assert(buffer != nullptr);
-        assert(buffer->source != nullptr);
-        return buffer->source->getCallbackField();
-    }
 
     // Channel is a field [but what kind of field!?]...
 
@@ -140,6 +225,8 @@ public:
     }
 
 protected:
+    friend class Checkpoint<ENV>;
+
     ChannelBuffer<ENV> *buffer;
 };
 
@@ -165,7 +252,10 @@ class Channel
 public:
     typedef T::SpaceTime SpaceTime;
     typedef T::Environment Environment;
+    typedef Environment::LambdaField LambdaField;
     friend class RemoteReference<T>;
+    friend class FanIn<T>;
+    friend class CheckpointWriter<Environment>;
 
     // a default writer indicates that the reader hasn't been generated yet
     Channel() : buffer(nullptr) {} 
@@ -176,10 +266,18 @@ public:
         moveFrom.buffer = nullptr;
     }
 
+    // Each channel has its own lambda field, which defaults to the simulation's lambdaField.
+    // The field can only differ between channels in its runtime parameters, as its type is the
+    // environment's LambdaField: with a ShiftedField that's the shift, so a channel with a larger
+    // shift allows the target to run further ahead of the source before blocking. A field with no
+    // runtime parameters (e.g. a bare InnerProdField, whose offset is a template parameter) is
+    // the same for every channel, so there's nothing to pass.
+
     // create a new channel to a remote target
-    Channel(CallbackChannel<Environment> &source, const Channel<T> &target) {
-        buffer = new ChannelBuffer<Environment>(source);
-        target.send([reader = ChannelReader(buffer)](T &obj) mutable {
+    Channel(CallbackChannel<Environment> &source, const Channel<T> &target,
+            LambdaField field = Simulation<Environment>::lambdaField) {
+        buffer = new QueueChannelBuffer<Environment>(source, std::move(field));
+        target.send([reader = ChannelExecutor<Environment>(buffer)](T &obj) mutable {
             obj.attach(std::move(reader));
         });
     }
@@ -189,47 +287,47 @@ public:
     }
 
     // create a new channel between two local agents
-    Channel(CallbackChannel<Environment> &source, T &target) {
-        buffer = new ChannelBuffer<Environment>(source);
+    Channel(CallbackChannel<Environment> &source, T &target,
+            LambdaField field = Simulation<Environment>::lambdaField) {
+        buffer = new QueueChannelBuffer<Environment>(source, std::move(field));
         target.attach(ChannelExecutor(buffer));
     }
 
 
-    ~Channel() {
-        if(buffer != nullptr) {
-            if(buffer->source == nullptr) {
-                delete(buffer);
-            } else {
-                buffer->source = nullptr;
-            }
-        }
-    }
+    ~Channel() { close(); }
 
     Channel &operator=(Channel<T> &&moveFrom) {
-        buffer = moveFrom.buffer;
-        moveFrom.buffer = nullptr;
+        if(&moveFrom != this) {
+            close();
+            buffer = moveFrom.buffer;
+            moveFrom.buffer = nullptr;
+        }
         return *this;
     }
 
+    // returns false if the channel has been closed at either end
     template<std::convertible_to<std::function<void(T &)>> LAMBDA>
     bool send(LAMBDA &&function) const {
-        if(buffer == nullptr) return false;
-        buffer->emplace(buffer->source->asLambdaField(), 
-            [f = std::forward<LAMBDA>(function)](Agent<Environment> &target) { 
+        if(!isOpen()) return false;
+        buffer->emplace(buffer->source.load()->asLambdaField(buffer->lambdaField), 
+            [f = std::forward<LAMBDA>(function)](Agent<Environment> &target) mutable { 
                 f(static_cast<T &>(target)); 
             });
         return true;
     }
 
+    // A channel is open until either its source or target closes it
+    bool isOpen() const { return buffer != nullptr && buffer->source != nullptr; }
+
     // get a remote reference to the target of this channel
     RemoteReference<T> target() {
         return {*this};
     }
 
 
-    const SpaceTime &sourcePosition() const {
+    SpaceTime sourcePosition() const {
         assert(buffer != nullptr);
-        return buffer->source->getCallbackField()->asPosition();
+        return buffer->source.load()->getCallbackField()->asPosition();
     }
 
 
@@ -240,27 +338,47 @@ public:
 
 
 protected:
-    ChannelBuffer<typename T::Environment> *buffer;
+    QueueChannelBuffer<typename T::Environment> *buffer;
+
+    Channel(QueueChannelBuffer<typename T::Environment> *buffer) : buffer(buffer) { }
+
+    // close the source end of the channel
+    void close() {
+        if(buffer != nullptr) {
+            buffer->closeWriter();
+            buffer = nullptr;
+        }
+    }
 };
 
 
 // Use this class to capture references to remote agents in lambda functions.
 // In this way, we can send references between agents.
 // This is necessary because an agent may need to block on a reference while it is in transit. 
-// This is implemented as a channel connected to a dummy source located at
-// the point of creation of the reference.
+// This is implemented as a channel connected to a stub source located at
+// the point of creation of the reference. The stub lives in the channel's buffer, so
+// creating a reference allocates nothing but the channel itself.
 template<class T>
 class RemoteReference {
 public:
     typedef T::Environment  Environment;
 
-    // create a new channel with a given target and a stub as source
-    RemoteReference(const Channel<T> &target) : 
-        outChannel(*new CallbackField<Environment>(target.sourcePosition()), target) { }
+    // create a new channel to the target of a channel, with a stub at the channel's source
+    RemoteReference(const Channel<T> &target) {
+        assert(target.isOpen());
+        RemoteChannelBuffer<Environment> *buffer = new RemoteChannelBuffer<Environment>(target.sourcePosition(), target.buffer->lambdaField);
+        target.send([reader = ChannelExecutor<Environment>(buffer)](T &obj) mutable {
+            obj.attach(std::move(reader));
+        });
+        outChannel.buffer = buffer;
+    }
 
     // create a new channel to a local target
-    RemoteReference(T &target) : 
-        outChannel(*new CallbackField<Environment>(target.position()), target) { } // If we have a raw reference to target it must be in same position
+    RemoteReference(T &target) { // If we have a raw reference to target it must be in same position
+        RemoteChannelBuffer<Environment> *buffer = new RemoteChannelBuffer<Environment>(target.position(), Simulation<Environment>::lambdaField);
+        target.attach(ChannelExecutor<Environment>(buffer));
+        outChannel.buffer = buffer;
+    }
 
     RemoteReference(RemoteReference<T> &&other) : outChannel(std::move(other.outChannel)) { }
 
@@ -270,18 +388,14 @@ public:
         throw(std::runtime_error("Don't try to copy construct an RemoteReference. Use std::move instead"));
     }
 
-    ~RemoteReference() {
-        if(outChannel.buffer != nullptr) { // channel is still connected to a stub object
-            delete(outChannel.buffer->source);
-        }
-    }
-
-    Channel<T> attachSource(SourceAgent<Environment> &source) {
-//        std::cout << this << " Attaching to source " << &source << std::endl;
+    // Replaces the stub with a real source, which should be in the future of the stub,
+    // and releases any agents blocked on the stub.
+    Channel<T> attachSource(CallbackChannel<Environment> &source) {
         assert(outChannel.buffer != nullptr);
-        assert(outChannel.buffer->source != nullptr);
-        delete(outChannel.buffer->source); // delete stub object (this will cause callbacks to be submitted)
-        outChannel.buffer->source = &source;
+        RemoteChannelBuffer<Environment> *buffer = static_cast<RemoteChannelBuffer<Environment> *>(outChannel.buffer);
+        CallbackChannel<Environment> *stub = &buffer->stub;
+        buffer->source.compare_exchange_strong(stub, &source); // unless the target has already closed
+        buffer->stub.releaseCallbacks();
         return std::move(outChannel);
     }
 
@@ -289,4 +403,34 @@ protected:
     Channel<T> outChannel;
 };
 
+
+// The buffer of a channel made by a RemoteReference, which contains the stub source
+// that the target blocks on until the reference is attached to a real source.
+// The stub's callback field is embedded too, and isn't owned by its shared pointer,
+// as it lives as long as the buffer. The pointer still has a control block, so that
+// the field can be referred to weakly (see AgentGroup).
+template<Environment ENV>
+class RemoteChannelBuffer : public QueueChannelBuffer<ENV> {
+protected:
+    template<class T> friend class RemoteReference;
+
+    CallbackField<ENV>      stubField;
+    CallbackChannel<ENV>    stub;
+
+    RemoteChannelBuffer(ENV::SpaceTime stubPosition, ENV::LambdaField field) :
+        QueueChannelBuffer<ENV>(stub, std::move(field)),
+        stubField(std::move(stubPosition)),
+        stub(std::shared_ptr<CallbackField<ENV>>(&stubField, [](CallbackField<ENV> *) { }, PoolAllocator<CallbackField<ENV>>())) { }
+
+public:
+    // If the reference is dropped before it's attached to a source, the target may be blocked
+    // on the stub, which will never move, so it's released to find the channel closed.
+    void closeWriter() override {
+        bool isStub = (this->source == &stub);
+        this->source = nullptr;
+        if(isStub) stub.releaseCallbacks();
+        this->releaseEnd();
+    }
+};
+
 #endif
@@ -0,0 +1,295 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <concepts>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include "Agent.h"
+#include "AgentGroup.h"
+#include "Channel.h"
+#include "TypedChannel.h"
+#include "Serialization.h"
+#include "Simulation.h"
+
+// Passed to an agent's save() method to write its state to a checkpoint.
+// Channels are written as references to their targets, and are remade on restore.
+template<Environment ENV>
+class CheckpointWriter {
+public:
+    template<class T> requires std::is_trivially_copyable_v<T>
+    void write(const T &value) { writeRaw(out, value); }
+
+    void write(const std::string &string) {
+        writeRaw(out, static_cast<uint64_t>(string.size()));
+        out.write(string.data(), string.size());
+    }
+
+    template<class T> requires std::is_trivially_copyable_v<T>
+    void write(const std::vector<T> &vector) {
+        writeRaw(out, static_cast<uint64_t>(vector.size()));
+        out.write(reinterpret_cast<const char *>(vector.data()), vector.size() * sizeof(T));
+    }
+
+    template<class T>
+    void write(const Channel<T> &channel) { writeChannel(channel.isOpen() ? channel.buffer : nullptr); }
+
+    template<class T, class... MESSAGES>
+    void write(const TypedChannel<T, MESSAGES...> &channel) { writeChannel(channel.isOpen() ? channel.buffer : nullptr); }
+
+    // Timers are closures, so can't be saved. An agent with timers should call this from save()
+    // if its checkpoint constructor sets them again, otherwise it can't be checkpointed.
+    void setsTimersOnRestore() { timersAreSet = true; }
+
+protected:
+    friend class Checkpoint<ENV>;
+
+    struct BufferRecord {
+        int64_t     id;
+        uint64_t    target;             // index of the target agent
+        bool        isWritten = false;  // whether the source end has been written
+    };
+
+    std::ostream &                                                  out;
+    std::unordered_map<const ChannelBuffer<ENV> *, BufferRecord> &  buffers;
+    bool                                                            timersAreSet = false;   // by the agent being saved
+
+    CheckpointWriter(std::ostream &out, std::unordered_map<const ChannelBuffer<ENV> *, BufferRecord> &buffers) : out(out), buffers(buffers) { }
+
+    void writeChannel(const ChannelBuffer<ENV> *buffer) {
+        int64_t id = -1;
+        if(buffer != nullptr) {
+            auto record = buffers.find(buffer);
+            if(record == buffers.end()) throw(std::runtime_error("Attempt to checkpoint a channel to an agent that isn't in the checkpoint"));
+            if(record->second.isWritten) throw(std::runtime_error("Attempt to checkpoint the same channel twice"));
+            record->second.isWritten = true;
+            id = record->second.id;
+        }
+        writeRaw(out, id);
+    }
+};
+
+
+// Passed to an agent's checkpoint constructor to read back what its save() method wrote, in the same order.
+// Channels should be read directly into the agent's members, as they are reconnected to their targets
+// once all agents have been made.
+template<Environment ENV>
+class CheckpointReader {
+public:
+    template<class T> requires std::is_trivially_copyable_v<T>
+    void read(T &value) { readRaw(in, value); }
+
+    template<class T> requires std::is_trivially_copyable_v<T>
+    T read() {
+        T value;
+        readRaw(in, value);
+        return value;
+    }
+
+    void read(std::string &string) {
+        string.resize(read<uint64_t>());
+        if(!in.read(string.data(), string.size())) throw(std::runtime_error("Unexpected end of checkpoint"));
+    }
+
+    template<class T> requires std::is_trivially_copyable_v<T>
+    void read(std::vector<T> &vector) {
+        vector.resize(read<uint64_t>());
+        if(!in.read(reinterpret_cast<char *>(vector.data()), vector.size() * sizeof(T))) throw(std::runtime_error("Unexpected end of checkpoint"));
+    }
+
+    template<class T>
+    void read(Channel<T> &channel) {
+        readChannel([&channel](CallbackChannel<ENV> &source, Agent<ENV> &target) {
+            channel = Channel<T>(source, targetAs<T>(target));
+        });
+    }
+
+    template<class T, class... MESSAGES>
+    void read(TypedChannel<T, MESSAGES...> &channel) {
+        readChannel([&channel](CallbackChannel<ENV> &source, Agent<ENV> &target) {
+            channel = TypedChannel<T, MESSAGES...>(source, targetAs<T>(target));
+        });
+    }
+
+protected:
+    friend class Checkpoint<ENV>;
+
+    struct Link {
+        uint64_t                                                    source; // index of the source agent
+        std::function<void(CallbackChannel<ENV> &, Agent<ENV> &)>   connect;
+    };
+
+    std::istream &                      in;
+    std::unordered_map<int64_t, Link>   links;          // by channel id
+    uint64_t                            currentAgent;   // index of the agent being read
+
+    CheckpointReader(std::istream &in) : in(in) { }
+
+    template<class F>
+    void readChannel(F &&connect) {
+        int64_t id = read<int64_t>();
+        if(id >= 0) links.try_emplace(id, currentAgent, std::forward<F>(connect));
+    }
+
+    template<class T>
+    static T &targetAs(Agent<ENV> &target) {
+        T *typedTarget = dynamic_cast<T *>(&target);
+        if(typedTarget == nullptr) throw(std::runtime_error("Channel in checkpoint has a target of the wrong type"));
+        return *typedTarget;
+    }
+};
+
+
+template<class T, class ENV>
+concept CheckpointableAgent =
+    std::derived_from<T, Agent<ENV>> &&
+    std::constructible_from<T, CheckpointReader<ENV> &> &&
+    requires(const T &agent, CheckpointWriter<ENV> &out) { agent.save(out); };
+
+
+// A Checkpoint saves a whole simulation to a file, so that it can be restored and continued
+// without replaying it from the beginning. A checkpoint is taken once Simulation::start() or
+// Simulation::runUntil() has returned, when every agent is blocked on the boundary. This is a consistent cut of the simulation, as
+// everything before the boundary has been executed and nothing after it has.
+//
+// Each type of agent in the simulation should be registered, and should have a method
+//     void save(CheckpointWriter<ENV> &out) const
+// which writes the agent's state, including its Channels and TypedChannels, and a constructor
+//     T(CheckpointReader<ENV> &in)
+// which reads it back. On restore, agents are constructed at the position and velocity they were saved with.
+//
+// Channels are remade between the restored agents, with the simulation's lambdaField. Unread messages on
+// TypedChannels of trivially copyable messages are saved, but closures can't be, so a Channel<T> must be
+// empty at the checkpoint. Timers aren't saved either, so an agent with timers should save what it needs
+// to set them again in its constructor, and say so with CheckpointWriter::setsTimersOnRestore().
+// The members of an AgentGroup aren't on the main thread's queue, so a simulation with groups
+// can't be checkpointed.
+//
+// To continue a simulation:
+//     checkpoint.restore("sim.checkpoint");
+//     Simulation<ENV>::runUntil(endTime);
+template<Environment ENV>
+class Checkpoint {
+public:
+    typedef ENV::SpaceTime  SpaceTime;
+
+    static constexpr uint64_t MAGIC = 0x54504b4353544f53;   // "SOTSCKPT"
+
+    template<CheckpointableAgent<ENV> T>
+    void registerType(std::string name) {
+        savers[typeid(T)] = {name, [](const Agent<ENV> &agent, CheckpointWriter<ENV> &out) {
+            static_cast<const T &>(agent).save(out);
+        }};
+        loaders[std::move(name)] = [](CheckpointReader<ENV> &in) -> Agent<ENV> * {
+            return new T(in);
+        };
+    }
+
+    // Saves all agents and the channels between them. Should be called after Simulation::start() or runUntil() has returned.
+    void save(const std::string &fileName) {
+        std::vector<Agent<ENV> *> agents(
+            Simulation<ENV>::mainThread.pCallbackBuffer->buffer.begin(),
+            Simulation<ENV>::mainThread.pCallbackBuffer->buffer.end());
+        std::unordered_map<const ChannelBuffer<ENV> *, typename CheckpointWriter<ENV>::BufferRecord> buffers;
+        for(uint64_t target = 0; target < agents.size(); ++target) {
+            for(ChannelExecutor<ENV> &inChannel : agents[target]->inChannels) {
+                if(!inChannel.isClosed()) buffers.try_emplace(inChannel.buffer, static_cast<int64_t>(buffers.size()), target);
+            }
+        }
+
+        std::ofstream out(fileName, std::ios::binary);
+        if(!out) throw(std::runtime_error("Can't open checkpoint file " + fileName));
+        CheckpointWriter<ENV> writer(out, buffers);
+        writeRaw(out, MAGIC);
+        writeRaw(out, static_cast<uint64_t>(agents.size()));
+        for(Agent<ENV> *agent : agents) {
+            const AgentGroup<ENV> *group = dynamic_cast<const AgentGroup<ENV> *>(agent);
+            if(group != nullptr && group->nMembers() != 0) throw(std::runtime_error("Attempt to checkpoint an AgentGroup, whose members can't be saved"));
+            auto type = savers.find(typeid(*agent));
+            if(type == savers.end()) throw(std::runtime_error(std::string("Attempt to checkpoint an agent of unregistered type ") + typeid(*agent).name()));
+            writer.write(type->second.name);
+            writePosition(out, agent->position());
+            writePosition<SpaceTime>(out, agent->vel);
+            writer.timersAreSet = false;
+            type->second.save(*agent, writer);
+            if(!agent->timers.empty() && !writer.timersAreSet) {
+                throw(std::runtime_error(std::string("Attempt to checkpoint an agent with timers that it doesn't set on restore, of type ") + type->second.name));
+            }
+        }
+
+        uint64_t nBuffers = 0;
+        for(auto &[buffer, record] : buffers) {
+            if(record.isWritten) {
+                ++nBuffers;
+            } else if(!const_cast<ChannelBuffer<ENV> *>(buffer)->empty()) {
+                throw(std::runtime_error("Attempt to checkpoint a channel with unread messages whose source isn't in the checkpoint"));
+            }
+        }
+        writeRaw(out, nBuffers);
+        for(auto &[buffer, record] : buffers) {
+            if(!record.isWritten) continue;
+            writeRaw(out, record.id);
+            writeRaw(out, record.target);
+            if(!const_cast<ChannelBuffer<ENV> *>(buffer)->writeMessages(out)) {
+                throw(std::runtime_error("Attempt to checkpoint a channel holding closures. Use a TypedChannel"));
+            }
+        }
+        if(!out) throw(std::runtime_error("Error writing checkpoint file " + fileName));
+    }
+
+    // Remakes the agents and channels in a checkpoint. Should be called on the main thread before Simulation::start().
+    void restore(const std::string &fileName) {
+        std::ifstream in(fileName, std::ios::binary);
+        if(!in) throw(std::runtime_error("Can't open checkpoint file " + fileName));
+        CheckpointReader<ENV> reader(in);
+        if(reader.template read<uint64_t>() != MAGIC) throw(std::runtime_error(fileName + " isn't a checkpoint"));
+
+        std::vector<Agent<ENV> *> agents(reader.template read<uint64_t>());
+        std::string typeName;
+        SpaceTime position;
+        SpaceTime velocity;
+        for(uint64_t i = 0; i < agents.size(); ++i) {
+            reader.read(typeName);
+            readPosition(in, position);
+            readPosition(in, velocity);
+            auto loader = loaders.find(typeName);
+            if(loader == loaders.end()) throw(std::runtime_error("Checkpoint contains an agent of unregistered type " + typeName));
+            // construct the agent at its saved position, then hand it to the main thread
+            SourceAgent<ENV> origin(position);
+            origin.vel = Velocity<SpaceTime>(velocity);
+            Simulation<ENV>::currentThreadAgent = &origin;
+            reader.currentAgent = i;
+            agents[i] = loader->second(reader);
+            Simulation<ENV>::currentThreadAgent = &Simulation<ENV>::mainThread;
+            Simulation<ENV>::mainThread.pCallbackBuffer->pushAll(origin.pCallbackBuffer->takeAll());
+        }
+
+        uint64_t nBuffers = reader.template read<uint64_t>();
+        for(uint64_t i = 0; i < nBuffers; ++i) {
+            int64_t id = reader.template read<int64_t>();
+            uint64_t target = reader.template read<uint64_t>();
+            auto link = reader.links.find(id);
+            if(link == reader.links.end() || target >= agents.size()) throw(std::runtime_error("Corrupt checkpoint file " + fileName));
+            link->second.connect(*agents[link->second.source], *agents[target]);
+            agents[target]->inChannels.back().buffer->readMessages(in);
+        }
+    }
+
+protected:
+    struct AgentType {
+        std::string                                                         name;
+        std::function<void(const Agent<ENV> &, CheckpointWriter<ENV> &)>    save;
+    };
+
+    std::unordered_map<std::type_index, AgentType>                                      savers;
+    std::unordered_map<std::string, std::function<Agent<ENV> *(CheckpointReader<ENV> &)>>  loaders;
+};
+
+#endif
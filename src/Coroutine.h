@@ -0,0 +1,204 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Concepts.h"
+#include "predeclarations.h"
+
+// Mix-in for agents whose behaviour is written as coroutines (member functions returning AgentTask).
+// It holds a pool that the frames of the agent's coroutines are allocated from, so
+// long-lived state machines don't allocate per step, and the coroutines that are still
+// suspended, which are destroyed along with the agent.
+class CoroutineFrames {
+public:
+    CoroutineFrames() = default;
+    CoroutineFrames(const CoroutineFrames &) = delete;
+
+    ~CoroutineFrames() {
+        while(!suspended.empty()) {
+            std::coroutine_handle<> task = suspended.back();
+            suspended.pop_back();
+            task.destroy();
+        }
+        for(FreeList &list : freeLists) {
+            for(void *block : list.blocks) ::operator delete(block);
+        }
+    }
+
+    // number of coroutines started but not yet finished
+    size_t nTasks() const { return suspended.size(); }
+
+protected:
+    friend class AgentTask;
+
+    struct FreeList {
+        size_t              size;
+        std::vector<void *> blocks;
+    };
+
+    std::vector<FreeList>               freeLists;  // one per frame size, there are few of these
+    std::vector<std::coroutine_handle<>> suspended;
+
+    void *allocate(size_t size) {
+        for(FreeList &list : freeLists) {
+            if(list.size == size && !list.blocks.empty()) {
+                void *block = list.blocks.back();
+                list.blocks.pop_back();
+                return block;
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void release(void *block, size_t size) {
+        for(FreeList &list : freeLists) {
+            if(list.size == size) {
+                list.blocks.push_back(block);
+                return;
+            }
+        }
+        freeLists.push_back({size, {block}});
+    }
+
+    void erase(std::coroutine_handle<> task) {
+        for(auto it = suspended.begin(); it != suspended.end(); ++it) {
+            if(*it == task) {
+                *it = suspended.back();
+                suspended.pop_back();
+                return;
+            }
+        }
+    }
+};
+
+
+// The return type of an agent's coroutine. The coroutine starts immediately, runs until it
+// first suspends, and is thereafter resumed directly by whatever it awaits:
+// a lambda putting a value into a Mailbox or the agent reaching a lab time (see reachLabTime()).
+// Since these are executed by the agent, the coroutine always runs on the agent's thread
+// at the agent's current position.
+//
+// An AgentTask is fire-and-forget: the frame is destroyed when the coroutine finishes
+// or, if it is still suspended, when the agent is deleted. An exception that escapes
+// the coroutine terminates the program.
+class AgentTask {
+public:
+    struct promise_type {
+        CoroutineFrames *frames = nullptr;
+
+        promise_type() = default;
+
+        // a member function of an agent derived from CoroutineFrames gets the agent as its first argument
+        // (GCC 12 deduces AGENT as a reference type for the implicit object argument, hence remove_cvref_t)
+        template<class AGENT, class... ARGS> requires std::derived_from<std::remove_cvref_t<AGENT>, CoroutineFrames>
+        promise_type(AGENT &agent, ARGS &&...) : frames(&agent) { }
+
+        // Frames of member functions of agents derived from CoroutineFrames come from the agent's pool.
+        // Each block is preceded by a header that records its pool, as operator delete is only given the block.
+        static constexpr size_t HEADERSIZE = alignof(std::max_align_t);
+
+        template<class AGENT, class... ARGS> requires std::derived_from<AGENT, CoroutineFrames>
+        static void *operator new(size_t size, AGENT &agent, ARGS &&...) {
+            CoroutineFrames &pool = agent;
+            char *block = static_cast<char *>(pool.allocate(size + HEADERSIZE));
+            *reinterpret_cast<CoroutineFrames **>(block) = &pool;
+            return block + HEADERSIZE;
+        }
+
+        static void *operator new(size_t size) {
+            char *block = static_cast<char *>(::operator new(size + HEADERSIZE));
+            *reinterpret_cast<CoroutineFrames **>(block) = nullptr;
+            return block + HEADERSIZE;
+        }
+
+        static void operator delete(void *frame, size_t size) {
+            char *block = static_cast<char *>(frame) - HEADERSIZE;
+            CoroutineFrames *pool = *reinterpret_cast<CoroutineFrames **>(block);
+            if(pool != nullptr) pool->release(block, size + HEADERSIZE); else ::operator delete(block);
+        }
+
+        AgentTask get_return_object() {
+            if(frames != nullptr) frames->suspended.push_back(std::coroutine_handle<promise_type>::from_promise(*this));
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept {
+            if(frames != nullptr) frames->erase(std::coroutine_handle<promise_type>::from_promise(*this));
+            return {};
+        }
+        void return_void() { }
+
+        // Nothing awaits an AgentTask, so there's nowhere to pass an exception on to,
+        // and, as with an exception that escapes a thread, the program terminates.
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+
+// A queue of values for a coroutine of an agent to co_await. Values are put into the
+// mailbox by lambdas executed on the agent, e.g.
+//     channel.send([x](MyAgent &agent) { agent.mailbox.put(x); });
+// which resume a waiting coroutine immediately.
+// Only one coroutine can wait on a Mailbox at a time.
+template<class VALUE>
+class Mailbox {
+public:
+    void put(VALUE value) {
+        values.push_back(std::move(value));
+        if(waiter) std::exchange(waiter, nullptr).resume();
+    }
+
+    bool empty() const { return values.empty(); }
+
+    auto operator co_await() {
+        struct Awaiter {
+            Mailbox<VALUE> &mailbox;
+
+            bool await_ready() const { return !mailbox.values.empty(); }
+            void await_suspend(std::coroutine_handle<> task) {
+                if(mailbox.waiter) throw(std::runtime_error("Only one coroutine can wait on a Mailbox"));
+                mailbox.waiter = task;
+            }
+            VALUE await_resume() {
+                VALUE value = std::move(mailbox.values.front());
+                mailbox.values.pop_front();
+                return value;
+            }
+        };
+        return Awaiter{*this};
+    }
+
+protected:
+    std::deque<VALUE>       values;
+    std::coroutine_handle<> waiter;
+};
+
+
+// Awaits the agent's trajectory reaching a given lab time, using a timer (see Agent::callAt).
+// The timer only holds the coroutine's handle, so doesn't allocate.
+template<Environment ENV>
+auto reachLabTime(Agent<ENV> &agent, typename ENV::SpaceTime::Time labTime) {
+    struct Awaiter {
+        Agent<ENV> &                    agent;
+        typename ENV::SpaceTime::Time   labTime;
+
+        bool await_ready() const { return agent.position().labTime() >= labTime; }
+        void await_suspend(std::coroutine_handle<> task) {
+            agent.callAt(labTime, [task]() { task.resume(); });
+        }
+        void await_resume() const { }
+    };
+    return Awaiter{agent, labTime};
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef FANIN_H
+#define FANIN_H
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "Concepts.h"
+#include "Channel.h"
+#include "predeclarations.h"
+
+
+// The reader end of a FanIn: one entry in the target's inChannels that merges the
+// channels from any number of sources.
+//
+// The sources are kept in a min-heap on the lab time, along the target's trajectory,
+// of their next event (see ChannelBuffer::timeToNext). A source's next event can only
+// get later (as the source moves into its future or its front lambda is executed) so the
+// keys in the heap are lower bounds and only the top need be recomputed to find the
+// earliest event. The keys are recomputed when the target leaves its trajectory.
+// As with separate channels, a lambda is executed before the target blocks on a source whose
+// next event is at the same time, so when the earliest source would block, the other sources
+// keyed at that time are checked for a lambda.
+template<Environment ENV>
+class FanInChannelBuffer : public ChannelBuffer<ENV> {
+public:
+    typedef ChannelBuffer<ENV>::Time                    Time;
+    typedef ChannelBuffer<ENV>::LambdaField             LambdaField;
+    typedef ChannelBuffer<ENV>::TranslatedLambdaField   TranslatedLambdaField;
+    typedef ENV::SpaceTime                              SpaceTime;
+
+    FanInChannelBuffer(LambdaField field) : ChannelBuffer<ENV>(std::move(field)) { }
+
+    // The channel from a new source. The key is a lower bound until it reaches the top of the heap.
+    void add(QueueChannelBuffer<ENV> *source) {
+        heap.push_back({std::numeric_limits<Time>::lowest(), source});
+        std::push_heap(heap.begin(), heap.end(), Entry::later);
+    }
+
+    size_t nSources() const { return heap.size(); }
+
+    bool empty() override { return next == nullptr || next->empty(); }
+
+    // The front of the source found by the last call to timeToNext.
+    const TranslatedLambdaField &frontField() override { return next->frontField(); }
+    void executeFront(Agent<ENV> &agent) override { next->executeFront(agent); }
+
+    void pop() override { next->pop(); }
+
+    void clear() override {
+        for(Entry &entry : heap) entry.source->clear();
+    }
+
+    Time timeToNext(const Agent<ENV> &agent, std::shared_ptr<CallbackField<ENV>> &blockingQueue) override {
+        if(agent.trajectoryChanges() != keyedTrajectory || !(agent.vel == keyedVelocity)) {
+            for(Entry &entry : heap) entry.labTime = std::numeric_limits<Time>::lowest();
+            keyedTrajectory = agent.trajectoryChanges();
+            keyedVelocity = agent.vel;
+        }
+        next = nullptr;
+        while(!heap.empty()) {
+            QueueChannelBuffer<ENV> *source = heap.front().source;
+            if(source->isClosed()) {
+                std::pop_heap(heap.begin(), heap.end(), Entry::later);
+                heap.pop_back();
+                source->closeReader();
+                continue;
+            }
+            std::shared_ptr<CallbackField<ENV>> sourceBlockingQueue;
+            Time time = source->timeToNext(agent, sourceBlockingQueue);
+            Time labTime = (time == std::numeric_limits<Time>::max() ? time : agent.position().labTime() + agent.vel.labTime()*time);
+            if(labTime > heap.front().labTime) { // key was stale, so re-sort
+                std::pop_heap(heap.begin(), heap.end(), Entry::later);
+                heap.back().labTime = labTime;
+                std::push_heap(heap.begin(), heap.end(), Entry::later);
+                continue;
+            }
+            if(sourceBlockingQueue) {
+                if(QueueChannelBuffer<ENV> *ready = lambdaAt(agent, labTime, time, source)) {
+                    next = ready;
+                    return time;
+                }
+            }
+            next = source;
+            blockingQueue = std::move(sourceBlockingQueue);
+            return time;
+        }
+        return std::numeric_limits<Time>::max();
+    }
+
+    // Stays open while the target holds its FanIn, so more sources can connect.
+    bool isClosed() override { return inbox == nullptr && heap.empty(); }
+
+    void closeReader() override {
+        for(Entry &entry : heap) entry.source->closeReader();
+        if(inbox != nullptr) *inbox = nullptr;
+        delete(this);
+    }
+
+protected:
+    template<class T> friend class FanIn;
+
+    struct Entry {
+        Time                        labTime;    // lower bound on the lab time of this source's next event
+        QueueChannelBuffer<ENV> *   source;
+
+        static bool later(const Entry &a, const Entry &b) { return a.labTime > b.labTime; }
+    };
+
+    std::vector<Entry>          heap;
+    QueueChannelBuffer<ENV> *   next = nullptr;     // source of the earliest event found by timeToNext
+    uint64_t                    keyedTrajectory = 0;
+    Velocity<SpaceTime>         keyedVelocity;
+    FanInChannelBuffer<ENV> **  inbox = nullptr;    // the FanIn's pointer to this, if the FanIn still exists
+
+    // A source, other than exclude, in the subheap at index whose next event is a lambda at or before
+    // the given lab time, or null if there is none. Only entries keyed at or before that time can be,
+    // and the heap is only descended through those. Their keys are left as they were, so remain lower bounds.
+    QueueChannelBuffer<ENV> *lambdaAt(const Agent<ENV> &agent, Time labTime, Time &time, const QueueChannelBuffer<ENV> *exclude, size_t index = 0) {
+        if(index >= heap.size() || heap[index].labTime > labTime) return nullptr;
+        QueueChannelBuffer<ENV> *source = heap[index].source;
+        if(source != exclude && !source->isClosed()) { // closed sources are removed when they reach the top
+            std::shared_ptr<CallbackField<ENV>> sourceBlockingQueue;
+            Time sourceTime = source->timeToNext(agent, sourceBlockingQueue);
+            if(!sourceBlockingQueue && agent.position().labTime() + agent.vel.labTime()*sourceTime <= labTime) {
+                time = sourceTime;
+                return source;
+            }
+        }
+        if(QueueChannelBuffer<ENV> *ready = lambdaAt(agent, labTime, time, exclude, 2*index + 1)) return ready;
+        return lambdaAt(agent, labTime, time, exclude, 2*index + 2);
+    }
+};
+
+
+// A FanIn merges the channels from many sources to a single target, so the target
+// has one entry in its inChannels however many sources send to it. This is for agents,
+// such as aggregators, that receive from many sources: to find the next lambda
+// the target only needs to look at the sources whose next events may be earliest,
+// rather than scanning all of them.
+//
+// The FanIn is held by the target, e.g. as a member, and connect() returns an ordinary
+// Channel from a new source. Since sources can connect at any time, a target with a FanIn
+// isn't deleted when all its sources have closed; it should die() or wait for the
+// end of the simulation.
+//
+// T is the type of the target, which should be derived from Agent<ENV>
+template<class T>
+class FanIn {
+public:
+    typedef T::Environment              Environment;
+    typedef Environment::LambdaField    LambdaField;
+
+    FanIn(T &target, LambdaField field = Simulation<Environment>::lambdaField) :
+        FanIn(target, new FanInChannelBuffer<Environment>(std::move(field))) { }
+
+    FanIn(const FanIn<T> &) = delete;
+    FanIn(FanIn<T> &&) = delete;
+
+    ~FanIn() {
+        if(buffer != nullptr) buffer->inbox = nullptr;
+    }
+
+    // Create a new channel to the target from a source at the same position as the target.
+    Channel<T> connect(CallbackChannel<Environment> &source) {
+        if(buffer == nullptr) throw(std::runtime_error("Attempt to connect to a FanIn whose target has closed it"));
+        QueueChannelBuffer<Environment> *sourceBuffer = new QueueChannelBuffer<Environment>(source, buffer->lambdaField);
+        std::shared_ptr<CallbackField<Environment>> blockingQueue;
+        if(sourceBuffer->timeToNext(*target, blockingQueue) < 0) {
+            delete(sourceBuffer);
+            throw(std::runtime_error("Attempt to attach channel to an agent's past"));
+        }
+        buffer->add(sourceBuffer);
+        return Channel<T>(sourceBuffer);
+    }
+
+    // number of sources, including any that have closed since the target last looked
+    size_t nSources() const { return buffer == nullptr ? 0 : buffer->nSources(); }
+
+protected:
+    T *                                 target;
+    FanInChannelBuffer<Environment> *   buffer;
+
+    // for FanIns whose buffer is derived from FanInChannelBuffer (e.g. Reduction)
+    FanIn(T &target, FanInChannelBuffer<Environment> *buffer) : target(&target), buffer(buffer) {
+        buffer->inbox = &this->buffer;
+        target.attach(ChannelExecutor<Environment>(buffer));
+    }
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef INITIALSTATE_H
+#define INITIALSTATE_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Agent.h"
+#include "BulkConstruction.h"
+#include "Serialization.h"
+#include "Simulation.h"
+#include "Velocity.h"
+
+// An InitialState is a memory-mapped file holding the starting positions, velocities and states of a population
+// of agents, and the edges of the channels between them, from which the agents and channels are made in bulk
+// (see BulkConstruction). The file is read in place, in parallel, so startup is bound by I/O rather than
+// by constructing agents one at a time.
+//
+// STATE is the data each agent is constructed from, and should be trivially copyable. A file is written with
+// InitialState::write() and loaded with e.g.
+//     InitialState<ENV, NodeState> initialState("nodes.init");
+//     std::vector<Node *> nodes = initialState.makeAgents<Node>([](const NodeState &state) { return new Node(state); });
+//     std::vector<Channel<Node>> channels = initialState.makeChannels(nodes, nodes);
+// Each agent is made at the position of the agent currently running on this thread and then jumps to its initial
+// position, which must be in that agent's future light-cone. All positions are checked before any agent is made.
+//
+// The file is a header, then a record of [position][velocity][STATE] for each agent, then
+// [uint64 source][uint64 target] for each edge. Positions are written as by writePosition().
+template<Environment ENV, class STATE> requires std::is_trivially_copyable_v<STATE>
+class InitialState {
+public:
+    typedef ENV::SpaceTime                              SpaceTime;
+    typedef BulkConstruction<ENV>::Edge                 Edge;
+
+    static constexpr uint64_t MAGIC = 0x54494e4953544f53;   // "SOTSINIT"
+    static constexpr size_t RECORDSIZE = 2 * positionSize<SpaceTime>() + sizeof(STATE);
+
+    struct Header {
+        uint64_t    magic;
+        uint64_t    recordSize;     // bytes per agent, to catch files written with a different SpaceTime or STATE
+        uint64_t    nAgents;
+        uint64_t    nEdges;
+    };
+
+    // The edges, read in place
+    class Edges {
+    public:
+        size_t size() const { return nEdges; }
+
+        Edge operator [](size_t index) const {
+            const char *data = edges + index * 2 * sizeof(uint64_t);
+            uint64_t source, target;
+            readRaw(data, source);
+            readRaw(data, target);
+            return Edge(source, target);
+        }
+
+    protected:
+        friend class InitialState<ENV, STATE>;
+        const char *    edges;
+        size_t          nEdges;
+
+        Edges(const char *edges, size_t nEdges) : edges(edges), nEdges(nEdges) { }
+    };
+
+    InitialState(const std::string &fileName) {
+        int file = open(fileName.c_str(), O_RDONLY);
+        if(file == -1) throw(std::runtime_error("Can't open initial state file " + fileName));
+        struct stat fileStat;
+        if(fstat(file, &fileStat) == -1 || fileStat.st_size < static_cast<off_t>(sizeof(Header))) {
+            close(file);
+            throw(std::runtime_error(fileName + " isn't an initial state file"));
+        }
+        size = fileStat.st_size;
+        data = static_cast<const char *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0));
+        close(file); // the mapping keeps the file open
+        if(data == MAP_FAILED) throw(std::runtime_error("Can't map initial state file " + fileName));
+        posix_madvise(const_cast<char *>(data), size, POSIX_MADV_SEQUENTIAL); // each thread reads a slice in order
+
+        const char *headerData = data;
+        readRaw(headerData, header);
+        if(header.magic != MAGIC || header.recordSize != RECORDSIZE ||
+           size != sizeof(Header) + header.nAgents * RECORDSIZE + header.nEdges * 2 * sizeof(uint64_t)) {
+            munmap(const_cast<char *>(data), size);
+            throw(std::runtime_error(fileName + " isn't an initial state file for this spacetime and state"));
+        }
+    }
+
+    InitialState(const InitialState &) = delete;
+
+    ~InitialState() { munmap(const_cast<char *>(data), size); }
+
+    size_t nAgents() const { return header.nAgents; }
+    size_t nEdges() const { return header.nEdges; }
+
+    SpaceTime position(size_t agent) const {
+        SpaceTime position;
+        const char *record = agentRecord(agent);
+        readPosition(record, position);
+        return position;
+    }
+
+    Velocity<SpaceTime> velocity(size_t agent) const {
+        SpaceTime velocity;
+        const char *record = agentRecord(agent) + positionSize<SpaceTime>();
+        readPosition(record, velocity);
+        return Velocity<SpaceTime>(velocity);
+    }
+
+    STATE state(size_t agent) const {
+        STATE state;
+        const char *record = agentRecord(agent) + 2 * positionSize<SpaceTime>();
+        readRaw(record, state);
+        return state;
+    }
+
+    Edges edges() const { return Edges(data + sizeof(Header) + header.nAgents * RECORDSIZE, header.nEdges); }
+
+    // Makes an agent for each record, calling make(state), which should construct the agent with new and return
+    // a pointer to it (see BulkConstruction::makeAgents). Each agent then jumps to its position and takes its velocity.
+    template<std::derived_from<Agent<ENV>> T, class F>
+    std::vector<T *> makeAgents(F &&make) const {
+        checkPositions();
+        return BulkConstruction<ENV>::template makeAgents<T>(nAgents(), [this, &make](size_t i) {
+            T *agent = make(state(i));
+            agent->jumpTo(position(i));
+            agent->vel = velocity(i);
+            return agent;
+        });
+    }
+
+    // Makes the channels between agents made by makeAgents(), in the order of the edges in the file
+    template<class TARGET, std::derived_from<CallbackChannel<ENV>> SOURCE>
+    std::vector<Channel<TARGET>> makeChannels(const std::vector<SOURCE *> &sources, const std::vector<TARGET *> &targets,
+                                              typename ENV::LambdaField field = Simulation<ENV>::lambdaField) const {
+        return BulkConstruction<ENV>::makeChannels(sources, targets, edges(), std::move(field));
+    }
+
+    // Checks that every agent's position is in the future light-cone of the agent currently running on this
+    // thread, so all can be jumped to. Throws, naming the first agent that isn't.
+    void checkPositions() const {
+        std::atomic<size_t> firstBadAgent = std::numeric_limits<size_t>::max();
+        SpaceTime origin = Simulation<ENV>::currentThreadAgent->position(); // not const, so < is the causal ordering
+        parallelFor(nAgents(), BulkConstruction<ENV>::MINPERTHREAD, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) {
+                SpaceTime from = origin;
+                if(!(from < position(i))) {
+                    size_t bad = firstBadAgent.load(std::memory_order_relaxed);
+                    while(i < bad && !firstBadAgent.compare_exchange_weak(bad, i, std::memory_order_relaxed)) { }
+                    return;
+                }
+            }
+        });
+        if(firstBadAgent != std::numeric_limits<size_t>::max()) {
+            throw(std::runtime_error("Initial position of agent " + std::to_string(firstBadAgent.load()) + " isn't in the future light-cone of its creator"));
+        }
+    }
+
+    // Writes an initial state file
+    static void write(const std::string &fileName, const std::vector<SpaceTime> &positions, const std::vector<Velocity<SpaceTime>> &velocities,
+                      const std::vector<STATE> &states, const std::vector<Edge> &edges) {
+        if(velocities.size() != positions.size() || states.size() != positions.size()) throw(std::runtime_error("Initial state needs a position, velocity and state for every agent"));
+        std::ofstream out(fileName, std::ios::binary);
+        if(!out) throw(std::runtime_error("Can't open initial state file " + fileName));
+        writeRaw(out, Header{MAGIC, RECORDSIZE, positions.size(), edges.size()});
+        for(size_t i = 0; i < positions.size(); ++i) {
+            writePosition(out, positions[i]);
+            writePosition<SpaceTime>(out, velocities[i]);
+            writeRaw(out, states[i]);
+        }
+        for(const Edge &edge : edges) {
+            writeRaw(out, static_cast<uint64_t>(edge.first));
+            writeRaw(out, static_cast<uint64_t>(edge.second));
+        }
+        if(!out) throw(std::runtime_error("Error writing initial state file " + fileName));
+    }
+
+protected:
+    const char *    data;
+    size_t          size;
+    Header          header;
+
+    const char *agentRecord(size_t agent) const { return data + sizeof(Header) + agent * RECORDSIZE; }
+};
+
+#endif
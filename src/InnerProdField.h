@@ -7,7 +7,7 @@
 /// @brief We define an InnerProductField to be a family of fields over an inner-product space of the form:
 /// F(X) = (X-Origin).(X-Origin) - Offset;
 /// for some constant vector X0 and constant c.
-template<class SPACETIME, SPACETIME::Time Offset = 0>
+template<class SPACETIME, SPACETIME::Time Offset = typename SPACETIME::Time()>
 class InnerProdField {
 public:
     typedef SPACETIME SpaceTime;
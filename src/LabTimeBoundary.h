@@ -2,17 +2,35 @@
 #define LABTIMEBOUNDARY_H
 
 #include "LinearField.h"
+#include "Velocity.h"
 
-// Represents a boundary at a constant time in the laboratory frame
-// LAMBDA should be a lambda function which takes an agent reference as argument.
-template<class SPACETIME, typename SPACETIME::Time EndTime>
-class LabTimeBoundary : public LinearField<SPACETIME, EndTime> {
+// A hyperplane of constant time in the laboratory frame, where the time can be set at runtime.
+// F(X) = L.X - labTime where L is the lab-frame velocity.
+template<class SPACETIME>
+class LabTimeField : public LinearField<SPACETIME> {
 public:
     typedef SPACETIME  SpaceTime;
+    typedef SPACETIME::Time Time;
 
-    LabTimeBoundary() : LinearField<SpaceTime,EndTime>(Velocity<SpaceTime>()) { }
+    Time labTime;
 
+    LabTimeField(Time time) : LinearField<SpaceTime>(Velocity<SpaceTime>()), labTime(time) { }
+
+    inline auto operator ()(const SpaceTime &pos) const {
+        return LinearField<SpaceTime>::operator ()(pos) - labTime;
+    }
 };
 
 
+// Represents a boundary at a constant time in the laboratory frame.
+// The boundary starts at EndTime, and can be moved later at runtime (see Simulation::runUntil)
+template<class SPACETIME, typename SPACETIME::Time EndTime = typename SPACETIME::Time()>
+class LabTimeBoundary : public LabTimeField<SPACETIME> {
+public:
+    typedef SPACETIME  SpaceTime;
+
+    LabTimeBoundary() : LabTimeField<SpaceTime>(EndTime) { }
+
+};
+
 #endif
@@ -6,7 +6,7 @@
 // Linear field over an inner product space. Gradient should be a unit vector (i.e. G.G=1)
 
 /// @brief Field of the form F(X) = Gradient.X - Offset
-template<class SpaceTime, SpaceTime::Time Offset=0>
+template<class SpaceTime, SpaceTime::Time Offset = typename SpaceTime::Time()>
 class LinearField {
 public:
 
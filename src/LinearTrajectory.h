@@ -66,7 +66,11 @@ public:
     // Intersection point of a field is the first point on the trajectory that the field is non negative
     template<FirstOrderField F>
     Time timeToIntersection(const F &field) const {
-        return -field(position())/field.d_dt(vel); // should be valid integer division when time is integer
+        if constexpr(std::integral<Time>) {
+            return ceilDiv<Time>(-field(position()), field.d_dt(vel));
+        } else {
+            return -field(position())/field.d_dt(vel);
+        }
     }
 
 
@@ -79,7 +83,11 @@ public:
         if constexpr(std::floating_point<Time>) sq += delta(sq); // ensure we don't round into negative
         if(sq < 0) return std::numeric_limits<Time>::max(); // never intersects
 
-        return (mb + sqrt(sq))/a;
+        if constexpr(std::integral<Time>) {
+            return ceilDiv<Time>(mb + isqrtCeil<Time>(sq), a);
+        } else {
+            return (mb + sqrt(sq))/a;
+        }
     }
 
 
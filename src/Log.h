@@ -0,0 +1,82 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+// Engine logging with levels fixed at compile time.
+// Messages below LOGLEVEL compile to nothing, so diagnostics can be left in hot paths.
+// Set the level with e.g. -DLOGLEVEL=0 to see everything, the default is to log warnings and errors.
+//
+// Each thread formats messages into its own buffer, which is written to std::clog in one go when it
+// fills, when an error is logged, at Log::flush() or when the thread exits, so threads don't
+// contend on the stream for each message.
+enum class LogLevel { Debug = 0, Info = 1, Warn = 2, Error = 3, None = 4 };
+
+#ifndef LOGLEVEL
+#define LOGLEVEL 2
+#endif
+
+class Log {
+public:
+    static constexpr LogLevel LEVEL = static_cast<LogLevel>(LOGLEVEL);
+    static constexpr size_t BUFFERSIZE = 1 << 14;   // bytes each thread buffers before writing
+
+    template<LogLevel L>
+    static constexpr bool isEnabled() { return L >= LEVEL && L != LogLevel::None; }
+
+    // Logs the arguments, which should have an operator <<, as one line, e.g.
+    //     Log::write<LogLevel::Debug>("Deleting agent ", this);
+    template<LogLevel L, class... ARGS>
+    static void write(ARGS &&... args) {
+        if constexpr(isEnabled<L>()) {
+            static constexpr const char *prefix[] = { "DEBUG: ", "INFO: ", "WARN: ", "ERROR: " };
+            if(hasExited) { // e.g. during static destruction, after this thread's buffer has gone
+                std::lock_guard<std::mutex> lock(mutex);
+                (std::clog << prefix[static_cast<int>(L)] << ... << std::forward<ARGS>(args)) << std::endl;
+                return;
+            }
+            ThreadBuffer &buffer = threadBuffer();
+            (buffer.out << prefix[static_cast<int>(L)] << ... << std::forward<ARGS>(args)) << '\n';
+            if(L == LogLevel::Error || buffer.out.tellp() >= static_cast<std::streamoff>(BUFFERSIZE)) buffer.flush();
+        }
+    }
+
+    // Writes this thread's buffered messages
+    static void flush() {
+        if(!hasExited) threadBuffer().flush();
+    }
+
+protected:
+    struct ThreadBuffer {
+        std::ostringstream  out;
+
+        ~ThreadBuffer() {
+            flush();
+            hasExited = true;
+        }
+
+        void flush() {
+            std::string messages = out.str();
+            if(messages.empty()) return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::clog.write(messages.data(), messages.size());
+                std::clog.flush();
+            }
+            out.str(std::string());
+        }
+    };
+
+    static inline std::mutex                mutex;              // for std::clog
+    static inline thread_local bool         hasExited = false;  // whether this thread's buffer has been destroyed
+
+    static ThreadBuffer &threadBuffer() {
+        static thread_local ThreadBuffer buffer;
+        return buffer;
+    }
+};
+
+#endif
@@ -122,6 +122,20 @@ auto dotProduct(const MinkowskiSpace<std::index_sequence<INDICES...>, TYPES...>
     return ((std::get<INDICES>(lhs) * std::get<INDICES>(rhs)) + ...);
 }
 
+// calculates the square of the spatial part of x in the lab frame, sum_{i>0} x_i*x_i
+template<size_t... SPACEINDICES, class... TYPES>
+auto spatialNormSquared(const MinkowskiSpace<std::index_sequence<0,SPACEINDICES...>, TYPES...> &x) {
+    typedef std::tuple_element_t<0,std::tuple<TYPES...>> Time;
+    return (Time() + ... + (std::get<SPACEINDICES>(x) * std::get<SPACEINDICES>(x)));
+}
+
+// calculates the lab-frame inner product of the spatial parts of lhs and rhs, sum_{i>0} lhs_i*rhs_i
+template<size_t... SPACEINDICES, class... TYPES>
+auto spatialDotProduct(const MinkowskiSpace<std::index_sequence<0,SPACEINDICES...>, TYPES...> &lhs, const MinkowskiSpace<TYPES...> &rhs) {
+    typedef std::tuple_element_t<0,std::tuple<TYPES...>> Time;
+    return (Time() + ... + (std::get<SPACEINDICES>(lhs) * std::get<SPACEINDICES>(rhs)));
+}
+
 template<size_t... INDICES, class... TYPES>
 MinkowskiSpace<TYPES...> elementwiseProduct(const MinkowskiSpace<std::index_sequence<INDICES...>, TYPES...> &lhs, const MinkowskiSpace<TYPES...> &rhs) {
     return MinkowskiSpace<TYPES...>((std::get<INDICES>(lhs) * std::get<INDICES>(rhs))...);
@@ -0,0 +1,201 @@
+#ifndef MULTICASTCHANNEL_H
+#define MULTICASTCHANNEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Concepts.h"
+#include "Channel.h"
+#include "predeclarations.h"
+
+// The lambdas sent down a MulticastChannel, shared by all its readers.
+// The log is a list of segments of SEGMENTSIZE lambdas, which only the source appends to. The number
+// of lambdas sent is published atomically, so readers find and execute lambdas without taking a lock,
+// each at its own cursor. The source frees a segment once the cursors of all open readers are past it.
+// It checks this when it adds a segment, so this costs O(readers) per SEGMENTSIZE lambdas sent.
+template<Environment ENV>
+class MulticastLog {
+public:
+    typedef ChannelBuffer<ENV>::Lambda Lambda;
+
+    static constexpr uint64_t SEGMENTSIZE = 64;
+    static constexpr uint64_t CLOSED = std::numeric_limits<uint64_t>::max();   // cursor of a reader that has stopped reading
+
+    struct Segment {
+        const uint64_t          begin;              // index of the first lambda in this segment
+        std::atomic<Segment *>  next = nullptr;
+        alignas(Lambda) std::byte storage[SEGMENTSIZE * sizeof(Lambda)];
+
+        Segment(uint64_t begin) : begin(begin) { }
+
+        uint64_t end() const { return begin + SEGMENTSIZE; }
+        Lambda &operator [](uint64_t index) { return *std::launder(reinterpret_cast<Lambda *>(storage) + (index - begin)); }
+    };
+
+    std::atomic<uint64_t>   endIndex = 0;   // number of lambdas sent
+
+    MulticastLog() : head(new Segment(0)), tail(head) { }
+
+    MulticastLog(const MulticastLog<ENV> &) = delete;
+
+    ~MulticastLog() {
+        while(head != nullptr) freeHead();
+    }
+
+    // The segment that the source is appending to
+    Segment *lastSegment() const { return tail; }
+
+    // Should only be called by the source. readers are the cursors of the readers, which bound which segments are still in use.
+    template<class F, class LAMBDA, class CURSORS>
+    void append(F &&field, LAMBDA &&function, const CURSORS &readers) {
+        uint64_t index = endIndex.load(std::memory_order_relaxed);
+        if(index == tail->end()) {
+            Segment *segment = new Segment(index);
+            tail->next.store(segment, std::memory_order_release);
+            tail = segment;
+            uint64_t firstUnread = CLOSED;
+            for(const auto *reader : readers) firstUnread = std::min(firstUnread, reader->cursorIndex());
+            // a reader only leaves a segment when it reads from the next, so is past a segment once its cursor is beyond the end
+            while(head != tail && firstUnread > head->end()) freeHead();
+        }
+        new(&(*tail)[index]) Lambda(std::forward<F>(field), std::forward<LAMBDA>(function));
+        endIndex.store(index + 1, std::memory_order_release);
+    }
+
+protected:
+    Segment *   head;   // earliest segment still held
+    Segment *   tail;
+
+    void freeHead() {
+        uint64_t end = std::min(head->end(), endIndex.load(std::memory_order_relaxed));
+        for(uint64_t i = head->begin; i < end; ++i) (*head)[i].~Lambda();
+        delete(std::exchange(head, head->next.load(std::memory_order_relaxed)));
+    }
+};
+
+
+// The buffer of a single reader of a MulticastChannel, which is just a cursor into the shared log.
+// Lambdas are called as const by all readers, possibly concurrently.
+template<Environment ENV>
+class MulticastChannelBuffer : public ChannelBuffer<ENV> {
+public:
+    typedef ChannelBuffer<ENV>::Lambda                  Lambda;
+    typedef ChannelBuffer<ENV>::LambdaField             LambdaField;
+    typedef ChannelBuffer<ENV>::TranslatedLambdaField   TranslatedLambdaField;
+    typedef MulticastLog<ENV>::Segment                  Segment;
+
+    // Should be called by the source, which is the only thread that appends to the log.
+    MulticastChannelBuffer(CallbackChannel<ENV> &source, LambdaField field, std::shared_ptr<MulticastLog<ENV>> sharedLog) :
+        ChannelBuffer<ENV>(source, std::move(field)), log(std::move(sharedLog)), cursor(log->endIndex.load(std::memory_order_relaxed)), segment(log->lastSegment()) { }
+
+    bool empty() override { return cursor.load(std::memory_order_relaxed) >= log->endIndex.load(std::memory_order_acquire); }
+
+    // The entry can't be freed until this reader's cursor has moved past its segment.
+    Lambda &front() {
+        uint64_t index = cursor.load(std::memory_order_relaxed);
+        if(index == segment->end()) segment = segment->next.load(std::memory_order_acquire);
+        return (*segment)[index];
+    }
+
+    const TranslatedLambdaField &frontField() override { return front().asField(); }
+
+    void executeFront(Agent<ENV> &agent) override { std::as_const(front())(agent); }
+
+    void pop() override {
+        front(); // moves on to the next segment if need be, before the source can see the cursor past it
+        cursor.store(cursor.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Called when the target closes its end, after which it reads nothing more and holds nothing in the log.
+    void clear() override { cursor.store(MulticastLog<ENV>::CLOSED, std::memory_order_release); }
+
+    // Index of the next lambda to read, or MulticastLog::CLOSED if the target has stopped reading
+    uint64_t cursorIndex() const { return cursor.load(std::memory_order_acquire); }
+
+protected:
+    std::shared_ptr<MulticastLog<ENV>>  log;
+    std::atomic<uint64_t>               cursor;     // written by the reader
+    Segment *                           segment;    // segment holding the cursor, or the one before if the cursor is at its end
+};
+
+
+// A MulticastChannel sends lambdas from one source to many targets.
+// Each lambda is type-erased and stored once, in a log shared by the targets, each of which
+// keeps its own place in the log, so targets don't contend with each other or with the source. Since all targets absorb a lambda from the same emission
+// field, each computes its own intersection with it.
+//
+// A lambda sent down a MulticastChannel is called as const, possibly concurrently
+// by different targets, so it shouldn't modify its captures.
+//
+// T is the type of the targets, which should be derived from Agent<ENV>
+template<class T>
+class MulticastChannel {
+public:
+    typedef T::SpaceTime                SpaceTime;
+    typedef T::Environment              Environment;
+    typedef Environment::LambdaField    LambdaField;
+
+    MulticastChannel(CallbackChannel<Environment> &source, LambdaField field = Simulation<Environment>::lambdaField) :
+        source(&source), lambdaField(std::move(field)), log(std::make_shared<MulticastLog<Environment>>()) { }
+
+    MulticastChannel(const MulticastChannel<T> &) = delete;
+
+    MulticastChannel(MulticastChannel<T> &&moveFrom) :
+        source(moveFrom.source), lambdaField(moveFrom.lambdaField), log(std::move(moveFrom.log)), readers(std::move(moveFrom.readers)) {
+        moveFrom.readers.clear();
+    }
+
+    ~MulticastChannel() { close(); }
+
+    // Adds a target at the same position as the source. The target receives all lambdas sent from now on.
+    void addTarget(T &target) {
+        readers.push_back(new MulticastChannelBuffer<Environment>(*source, lambdaField, log));
+        target.attach(ChannelExecutor(readers.back()));
+    }
+
+    // Sends a lambda to all targets whose end of the channel is still open.
+    // Returns the number of targets it was sent to.
+    template<std::convertible_to<std::function<void(T &)>> LAMBDA>
+    size_t send(LAMBDA &&function) {
+        removeClosedReaders();
+        if(readers.empty()) return 0;
+        log->append(source->asLambdaField(lambdaField),
+            [f = std::forward<LAMBDA>(function)](Agent<Environment> &target) {
+                f(static_cast<T &>(target));
+            }, readers);
+        return readers.size();
+    }
+
+    // Number of targets whose end of the channel was open at the last send. A target that
+    // closes its end holds nothing in the log from then on, but its buffer is only freed at the next send.
+    size_t size() const { return readers.size(); }
+
+protected:
+    CallbackChannel<Environment> *                      source;
+    LambdaField                                         lambdaField;
+    std::shared_ptr<MulticastLog<Environment>>          log;
+    std::vector<MulticastChannelBuffer<Environment> *>  readers;
+
+    // Deletes the buffers of targets that have closed their end.
+    void removeClosedReaders() {
+        std::erase_if(readers, [](MulticastChannelBuffer<Environment> *reader) {
+            if(reader->cursorIndex() != MulticastLog<Environment>::CLOSED && reader->source != nullptr) return false;
+            reader->closeWriter();
+            return true;
+        });
+    }
+
+    // close the source end of the channel to all targets
+    void close() {
+        for(MulticastChannelBuffer<Environment> *reader : readers) reader->closeWriter();
+        readers.clear();
+    }
+};
+
+#endif
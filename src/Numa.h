@@ -0,0 +1,165 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// The NUMA nodes of this machine, read from sysfs, and the node each thread runs on.
+//
+// Nodes are numbered 0..nNodes()-1 here (the kernel's node numbers may have gaps). A thread that
+// has been pinned (with pinToCpu or pinToNode) is on the node it was pinned to, otherwise it's on the
+// node of the core it first asked from, as that's where its memory will have been allocated (see Pool).
+// On a machine without NUMA, or where sysfs can't be read, there's one node with all the cores.
+//
+// This uses the kernel's interfaces directly, so needs no libnuma. On other systems there's always
+// one node, and threads aren't pinned.
+class Numa {
+public:
+    static size_t nNodes() { return topology().cpus.size(); }
+
+    // The cores on a given node
+    static const std::vector<int> &cpusOfNode(size_t node) { return topology().cpus[node]; }
+
+    static size_t currentNode() {
+        if(threadNode == UNKNOWN) {
+#ifdef __linux__
+            threadNode = nodeOfCpu(sched_getcpu());
+#else
+            threadNode = 0;
+#endif
+        }
+        return threadNode;
+    }
+
+    static size_t nodeOfCpu(int cpu) {
+        const Topology &topo = topology();
+        return (cpu >= 0 && static_cast<size_t>(cpu) < topo.nodeOfCpu.size()) ? topo.nodeOfCpu[cpu] : 0;
+    }
+
+    // Pins the calling thread to a core, on a given node. Returns false if it couldn't be pinned.
+    static bool pinToCpu([[maybe_unused]] int cpu, size_t node) {
+        threadNode = node;
+#ifdef __linux__
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // Pins the calling thread to all the cores of a node. Returns false if it couldn't be pinned.
+    static bool pinToNode(size_t node) {
+        threadNode = node;
+#ifdef __linux__
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for(int cpu : cpusOfNode(node)) CPU_SET(cpu, &cpuSet);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // Asks the kernel to put the pages of [memory, memory+size) on a given node, moving any that are
+    // already elsewhere. memory should be page aligned. This is only advice, so failure is ignored.
+    static void preferNode([[maybe_unused]] void *memory, [[maybe_unused]] size_t size, [[maybe_unused]] size_t node) {
+        if(nNodes() < 2) return;
+#ifdef __linux__
+        unsigned long nodeMask[NODEMASKWORDS] = {};
+        int kernelNode = topology().kernelNode[node];
+        if(kernelNode >= static_cast<int>(NODEMASKWORDS * BITSPERWORD)) return;
+        nodeMask[kernelNode / BITSPERWORD] = 1ul << (kernelNode % BITSPERWORD);
+        syscall(SYS_mbind, memory, size, MPOL_PREFERRED, nodeMask, NODEMASKWORDS * BITSPERWORD, MPOL_MF_MOVE);
+#endif
+    }
+
+protected:
+    static constexpr size_t UNKNOWN = static_cast<size_t>(-1);
+    static constexpr size_t BITSPERWORD = 8 * sizeof(unsigned long);
+    static constexpr size_t NODEMASKWORDS = 1024 / BITSPERWORD;
+
+    struct Topology {
+        std::vector<std::vector<int>>   cpus;       // by node
+        std::vector<int>                kernelNode; // the kernel's number for each node
+        std::vector<size_t>             nodeOfCpu;
+    };
+
+    static inline thread_local size_t threadNode = UNKNOWN;
+
+    static const Topology &topology() {
+        static const Topology *topo = readTopology(); // never deleted, as it's used by the pools during static destruction
+        return *topo;
+    }
+
+    // Reads the nodes from sysfs, or from a directory laid out in the same way
+    static Topology *readTopology([[maybe_unused]] const std::filesystem::path &nodeDirectory = "/sys/devices/system/node") {
+        std::map<int, std::vector<int>> cpusByKernelNode;
+#ifdef __linux__
+        std::error_code error;
+        for(const auto &entry : std::filesystem::directory_iterator(nodeDirectory, error)) {
+            std::string name = entry.path().filename().string();
+            int kernelNode;
+            if(name.rfind("node", 0) != 0 || std::from_chars(name.data() + 4, name.data() + name.size(), kernelNode).ptr != name.data() + name.size()) continue;
+            std::ifstream cpuList(entry.path() / "cpulist");
+            std::string cpus;
+            std::getline(cpuList, cpus);
+            std::vector<int> nodeCpus = parseCpuList(cpus);
+            if(!nodeCpus.empty()) cpusByKernelNode[kernelNode] = std::move(nodeCpus); // memory-only nodes have no cores to run workers
+        }
+#endif
+        if(cpusByKernelNode.empty()) {
+            for(unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu) cpusByKernelNode[0].push_back(cpu);
+        }
+        Topology *topo = new Topology();
+        for(auto &[kernelNode, cpus] : cpusByKernelNode) {
+            for(int cpu : cpus) {
+                if(static_cast<size_t>(cpu) >= topo->nodeOfCpu.size()) topo->nodeOfCpu.resize(cpu + 1, 0);
+                topo->nodeOfCpu[cpu] = topo->cpus.size();
+            }
+            topo->kernelNode.push_back(kernelNode);
+            topo->cpus.push_back(std::move(cpus));
+        }
+        return topo;
+    }
+
+    // parses a list of cores in the kernel's format, e.g. "0-3,8-11"
+    static std::vector<int> parseCpuList(const std::string &list) {
+        std::vector<int> cpus;
+        const char *pos = list.data();
+        const char *end = list.data() + list.size();
+        while(pos < end) {
+            int first, last;
+            auto [afterFirst, error] = std::from_chars(pos, end, first);
+            if(error != std::errc()) break;
+            last = first;
+            pos = afterFirst;
+            if(pos < end && *pos == '-') {
+                auto [afterLast, lastError] = std::from_chars(pos + 1, end, last);
+                if(lastError != std::errc()) break;
+                pos = afterLast;
+            }
+            for(int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+            if(pos < end && *pos == ',') ++pos; else break;
+        }
+        return cpus;
+    }
+};
+
+#endif
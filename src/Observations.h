@@ -0,0 +1,210 @@
+#ifndef OBSERVATIONS_H
+#define OBSERVATIONS_H
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Simulation.h"
+#include "Serialization.h"
+
+// An ObservationSink collects records of type RECORD from agents, each at a position in spacetime,
+// and outputs them in order of lab time.
+//
+// Agents call record(), which appends to a buffer belonging to the calling thread, so recording takes
+// no locks and threads never wait for each other. When the simulation isn't running (e.g. after
+// Simulation::runUntil() has returned) flush(watermark) hands the buffers to a background thread, which
+// merges them and outputs the records up to the watermark in lab-time order, while the simulation carries on.
+// Records at equal lab times are ordered by the rest of their position, if positions are tuples of
+// coordinates (e.g. MinkowskiSpace), and then by the record, if records have operator <. When both hold
+// the output is deterministic, otherwise records that tie come out in an unspecified order.
+//
+// The output is a function called on the background thread. csvOutput() and binaryOutput() make outputs to a stream.
+template<Environment ENV, class RECORD>
+class ObservationSink {
+public:
+    typedef ENV::SpaceTime                                          SpaceTime;
+    typedef ENV::SpaceTime::Time                                    Time;
+    typedef std::function<void(const SpaceTime &, const RECORD &)>  Output;
+
+    struct Observation {
+        SpaceTime   position;
+        RECORD      record;
+    };
+
+    ObservationSink(Output output) : output(std::move(output)), serialNumber(nextSerialNumber++), merger([this]() { mergeLoop(); }) { }
+
+    ObservationSink(const ObservationSink &) = delete;
+
+    // Outputs everything that's left
+    ~ObservationSink() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isClosing = true;
+        }
+        batchAdded.notify_one();
+        merger.join();
+    }
+
+    // Records an observation at the position of the agent that's currently running on this thread.
+    void record(RECORD record) {
+        threadBuffer().emplace_back(Simulation<ENV>::currentThreadAgent->position(), std::move(record));
+    }
+
+    void record(const SpaceTime &position, RECORD record) {
+        threadBuffer().emplace_back(position, std::move(record));
+    }
+
+    // Outputs the records up to a lab time, on the background thread. Records after the watermark are
+    // held back until a later flush. This should only be called while the simulation isn't running.
+    void flush(Time watermark = std::numeric_limits<Time>::max()) {
+        Batch batch{watermark, {}};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(std::unique_ptr<std::vector<Observation>> &buffer : buffers) {
+                if(!buffer->empty()) batch.runs.push_back(std::move(*buffer));
+                buffer->clear();
+            }
+            batches.push_back(std::move(batch));
+        }
+        batchAdded.notify_one();
+    }
+
+    // Waits until everything flushed so far has been output.
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        batchDone.wait(lock, [this]() { return batches.empty() && !isMerging; });
+    }
+
+    // Writes each observation as a line of comma separated coordinates followed by the record, which should have an operator <<
+    static Output csvOutput(std::ostream &out) {
+        return [&out](const SpaceTime &position, const RECORD &record) {
+            if constexpr(HASCOORDINATES) {
+                writeCsvCoordinates(out, position);
+            } else {
+                out << position.labTime() << ',';
+            }
+            out << record << '\n';
+        };
+    }
+
+    // Writes each observation as the coordinates of its position followed by the bytes of the record, which should be trivially copyable.
+    static Output binaryOutput(std::ostream &out) requires std::is_trivially_copyable_v<RECORD> {
+        return [&out](const SpaceTime &position, const RECORD &record) {
+            writePosition(out, position);
+            writeRaw(out, record);
+        };
+    }
+
+protected:
+    struct Batch {
+        Time                                        watermark;
+        std::vector<std::vector<Observation>>       runs;   // one per thread, unsorted
+    };
+
+    static inline std::atomic<uint64_t> nextSerialNumber = 0;
+
+    Output                                              output;
+    uint64_t                                            serialNumber;   // identifies this in the threads' buffer tables
+    std::mutex                                          mutex;
+    std::condition_variable                             batchAdded;
+    std::condition_variable                             batchDone;
+    std::vector<std::unique_ptr<std::vector<Observation>>> buffers;     // one per thread that has recorded
+    std::deque<Batch>                                   batches;        // flushed, waiting to be merged
+    std::vector<Observation>                            heldBack;       // sorted records after the last watermark
+    bool                                                isMerging = false;
+    bool                                                isClosing = false;
+    std::thread                                         merger;         // last, so it starts after everything else is constructed
+
+    // This thread's buffer, which is made on the thread's first record
+    std::vector<Observation> &threadBuffer() {
+        static thread_local std::unordered_map<uint64_t, std::vector<Observation> *> threadBuffers;
+        std::vector<Observation> *&buffer = threadBuffers[serialNumber];
+        if(buffer == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(std::make_unique<std::vector<Observation>>());
+            buffer = buffers.back().get();
+        }
+        return *buffer;
+    }
+
+    // Whether positions are tuples of coordinates (e.g. MinkowskiSpace)
+    template<class... COORDS> static std::true_type isTuple(const std::tuple<COORDS...> *);
+    static std::false_type isTuple(...);
+    static constexpr bool HASCOORDINATES = decltype(isTuple(std::declval<SpaceTime *>()))::value;
+
+    static bool earlier(const Observation &a, const Observation &b) {
+        if(a.position.labTime() != b.position.labTime()) return a.position.labTime() < b.position.labTime();
+        if constexpr(HASCOORDINATES) {
+            if(coordinatesLess(a.position, b.position)) return true;
+            if(coordinatesLess(b.position, a.position)) return false;
+        }
+        if constexpr(std::totally_ordered<RECORD>) return a.record < b.record;
+        return false;
+    }
+
+    template<class... COORDS>
+    static bool coordinatesLess(const std::tuple<COORDS...> &a, const std::tuple<COORDS...> &b) { return a < b; }
+
+    template<class... COORDS>
+    static void writeCsvCoordinates(std::ostream &out, const std::tuple<COORDS...> &coords) {
+        std::apply([&out](const COORDS &... coord) { ((out << coord << ','), ...); }, coords);
+    }
+
+    void mergeLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            batchAdded.wait(lock, [this]() { return !batches.empty() || isClosing; });
+            if(batches.empty()) return;
+            Batch batch = std::move(batches.front());
+            batches.pop_front();
+            isMerging = true;
+            lock.unlock();
+            merge(batch);
+            lock.lock();
+            isMerging = false;
+            batchDone.notify_all();
+        }
+    }
+
+    // k-way merge of the sorted runs of a batch, and the records held back from the last batch
+    void merge(Batch &batch) {
+        if(!heldBack.empty()) batch.runs.push_back(std::move(heldBack));
+        heldBack.clear();
+        for(std::vector<Observation> &run : batch.runs) std::stable_sort(run.begin(), run.end(), earlier);
+
+        typedef std::pair<size_t, size_t> Cursor; // (run, index)
+        auto later = [&batch](const Cursor &a, const Cursor &b) {
+            return earlier(batch.runs[b.first][b.second], batch.runs[a.first][a.second]);
+        };
+        std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heads(later);
+        for(size_t run = 0; run < batch.runs.size(); ++run) heads.emplace(run, 0);
+        while(!heads.empty()) {
+            auto [run, index] = heads.top();
+            heads.pop();
+            Observation &observation = batch.runs[run][index];
+            if(observation.position.labTime() > batch.watermark) {
+                heldBack.push_back(std::move(observation));
+            } else {
+                output(observation.position, observation.record);
+            }
+            if(++index < batch.runs[run].size()) heads.emplace(run, index);
+        }
+    }
+};
+
+#endif
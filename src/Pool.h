@@ -0,0 +1,334 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <concepts>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Numa.h"
+
+// Pools for the small objects that the engine makes and deletes at a high rate on many threads
+// (agents, channel buffers, callback fields and the lambdas sent down channels).
+//
+// Blocks are in size classes of multiples of alignof(std::max_align_t) up to MAXSIZE. Each thread
+// allocates from, and releases to, free lists of its own, so needs no lock. Blocks move between a thread
+// and the central free lists in batches, when a thread runs out or has released more than it needs,
+// so a block made on one thread and deleted on another (e.g. a channel buffer, deleted by whichever end
+// closes last) finds its way back. New blocks are cut from slabs of SLABSIZE bytes. There are central lists
+// for each NUMA node, and a thread uses those of the node it runs on (see Numa), whose slabs are placed on
+// that node, so an agent made by a worker pinned to a node lives on that node. The memory isn't given
+// back to the system, as it will be reused by later agents, and the central lists are never deleted
+// so that agents can still be deleted at the end of a simulation during static destruction.
+//
+// Define NOPOOLS to allocate everything with the global operator new (e.g. to find memory errors with a sanitizer).
+class Pool {
+public:
+    static constexpr size_t GRANULARITY = alignof(std::max_align_t);
+    static constexpr size_t MAXSIZE = 512;          // larger blocks come from the global operator new
+    static constexpr size_t NSIZECLASSES = MAXSIZE / GRANULARITY;
+    static constexpr size_t SLABSIZE = 1 << 16;
+    static constexpr size_t BATCHSIZE = 32;         // blocks moved between a thread and the central lists at a time
+    static constexpr size_t SLABALIGNMENT = 4096;   // page aligned, so slabs can be placed on a NUMA node
+
+    static void *allocate(size_t size) {
+#ifndef NOPOOLS
+        if(size <= MAXSIZE) {
+            size_t sizeClass = sizeClassOf(size);
+            if(hasExited) return centralList(Numa::currentNode(), sizeClass).allocate(sizeClass);
+            ThreadCache &cache = threadCache();
+            FreeList &list = cache.lists[sizeClass];
+            if(list.empty()) centralList(cache.node, sizeClass).refill(list, sizeClass);
+            return list.pop();
+        }
+#endif
+        return ::operator new(size);
+    }
+
+    // size should be the size that was allocated
+    static void release(void *block, size_t size) noexcept {
+        if(block == nullptr) return;
+#ifndef NOPOOLS
+        if(size <= MAXSIZE) {
+            size_t sizeClass = sizeClassOf(size);
+            if(hasExited) { // e.g. during static destruction, after this thread's lists have gone
+                centralList(Numa::currentNode(), sizeClass).release(static_cast<Block *>(block));
+                return;
+            }
+            ThreadCache &cache = threadCache();
+            FreeList &list = cache.lists[sizeClass];
+            list.push(static_cast<Block *>(block));
+            if(list.size > 2 * BATCHSIZE) centralList(cache.node, sizeClass).takeBatch(list);
+            return;
+        }
+#endif
+        ::operator delete(block);
+    }
+
+protected:
+    struct Block {
+        Block *next;
+    };
+
+    struct FreeList {
+        Block * head = nullptr;
+        size_t  size = 0;
+
+        bool empty() const { return head == nullptr; }
+
+        void push(Block *block) {
+            block->next = head;
+            head = block;
+            ++size;
+        }
+
+        Block *pop() {
+            Block *block = head;
+            head = block->next;
+            --size;
+            return block;
+        }
+    };
+
+    struct CentralList {
+        std::mutex              mutex;
+        FreeList                blocks;
+        std::vector<char *>     slabs;
+        size_t                  node;
+
+        // moves a batch of blocks to a thread's list, cutting a new slab if there are none
+        void refill(FreeList &list, size_t sizeClass) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(blocks.empty()) cutSlab(sizeClass);
+            for(size_t i = 0; i < BATCHSIZE && !blocks.empty(); ++i) list.push(blocks.pop());
+        }
+
+        // takes a batch of blocks from a thread's list
+        void takeBatch(FreeList &list) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(size_t i = 0; i < BATCHSIZE; ++i) blocks.push(list.pop());
+        }
+
+        void takeAll(FreeList &list) {
+            std::lock_guard<std::mutex> lock(mutex);
+            while(!list.empty()) blocks.push(list.pop());
+        }
+
+        void *allocate(size_t sizeClass) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(blocks.empty()) cutSlab(sizeClass);
+            return blocks.pop();
+        }
+
+        void release(Block *block) {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks.push(block);
+        }
+
+        void cutSlab(size_t sizeClass) {
+            size_t blockSize = (sizeClass + 1) * GRANULARITY;
+            slabs.push_back(static_cast<char *>(::operator new(SLABSIZE, std::align_val_t(SLABALIGNMENT))));
+            Numa::preferNode(slabs.back(), SLABSIZE, node);
+            for(size_t offset = SLABSIZE - SLABSIZE % blockSize; offset >= blockSize; offset -= blockSize) {
+                blocks.push(reinterpret_cast<Block *>(slabs.back() + offset - blockSize));
+            }
+        }
+    };
+
+    // A thread's free lists, which are given to the central lists when the thread exits
+    struct ThreadCache {
+        FreeList    lists[NSIZECLASSES];
+        size_t      node = Numa::currentNode();
+
+        ~ThreadCache() {
+            for(size_t sizeClass = 0; sizeClass < NSIZECLASSES; ++sizeClass) centralList(node, sizeClass).takeAll(lists[sizeClass]);
+            hasExited = true;
+        }
+    };
+
+    static inline thread_local bool hasExited = false;  // whether this thread's cache has been destroyed
+
+    static constexpr size_t sizeClassOf(size_t size) { return size == 0 ? 0 : (size - 1) / GRANULARITY; }
+
+    static ThreadCache &threadCache() {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    static CentralList &centralList(size_t node, size_t sizeClass) {
+        static CentralList *lists = newCentralLists(); // never deleted, see above
+        return lists[node * NSIZECLASSES + sizeClass];
+    }
+
+    static CentralList *newCentralLists() {
+        CentralList *lists = new CentralList[Numa::nNodes() * NSIZECLASSES];
+        for(size_t i = 0; i < Numa::nNodes() * NSIZECLASSES; ++i) lists[i].node = i / NSIZECLASSES;
+        return lists;
+    }
+};
+
+
+// Mix-in that allocates objects of a class, and of classes derived from it, from the Pool.
+// A derived class can define its own operator new and delete to be allocated some other way.
+class PoolAllocated {
+public:
+    static void *operator new(size_t size) { return Pool::allocate(size); }
+    static void operator delete(void *block, size_t size) noexcept { Pool::release(block, size); }
+
+    // over-aligned types, and placement new, aren't pooled
+    static void *operator new(size_t size, std::align_val_t alignment) { return ::operator new(size, alignment); }
+    static void operator delete(void *block, size_t size, std::align_val_t alignment) noexcept { ::operator delete(block, size, alignment); }
+    static void *operator new(size_t, void *where) noexcept { return where; }
+    static void operator delete(void *, void *) noexcept { }
+};
+
+
+// Allocator for standard containers and std::allocate_shared, that allocates from the Pool
+template<class T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() = default;
+    template<class U> PoolAllocator(const PoolAllocator<U> &) { }
+
+    T *allocate(size_t n) {
+        if constexpr(alignof(T) > Pool::GRANULARITY) {
+            return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        } else {
+            return static_cast<T *>(Pool::allocate(n * sizeof(T)));
+        }
+    }
+
+    void deallocate(T *block, size_t n) noexcept {
+        if constexpr(alignof(T) > Pool::GRANULARITY) {
+            ::operator delete(block, std::align_val_t(alignof(T)));
+        } else {
+            Pool::release(block, n * sizeof(T));
+        }
+    }
+
+    template<class U> bool operator ==(const PoolAllocator<U> &) const { return true; }
+};
+
+
+// A move-only std::function whose target is held in the function itself if it is small,
+// otherwise in a block from the Pool (or from the global operator new, if the target is over-aligned).
+// Like std::function, calling it is const but calls the target as non-const.
+template<class SIGNATURE> class PooledFunction;
+
+template<class R, class... ARGS>
+class PooledFunction<R(ARGS...)> {
+public:
+    PooledFunction() = default;
+
+    template<class F> requires (!std::same_as<std::decay_t<F>, PooledFunction>) && std::invocable<std::decay_t<F> &, ARGS...>
+    PooledFunction(F &&function) : operations(&OPERATIONS<std::decay_t<F>>) {
+        typedef std::decay_t<F> Function;
+        if constexpr(isLocal<Function>()) {
+            ::new(storage) Function(std::forward<F>(function));
+        } else {
+            Function *target = allocate<Function>();
+            try {
+                ::new(target) Function(std::forward<F>(function));
+            } catch(...) {
+                release(target);
+                throw;
+            }
+            *reinterpret_cast<Function **>(storage) = target;
+        }
+    }
+
+    PooledFunction(const PooledFunction &) = delete;
+
+    PooledFunction(PooledFunction &&other) noexcept : operations(other.operations) {
+        if(operations != nullptr) operations->move(other.storage, storage);
+        other.operations = nullptr;
+    }
+
+    PooledFunction &operator =(PooledFunction &&other) noexcept {
+        if(&other != this) {
+            if(operations != nullptr) operations->destroy(storage);
+            operations = other.operations;
+            if(operations != nullptr) operations->move(other.storage, storage);
+            other.operations = nullptr;
+        }
+        return *this;
+    }
+
+    ~PooledFunction() {
+        if(operations != nullptr) operations->destroy(storage);
+    }
+
+    R operator ()(ARGS... args) const { return operations->invoke(storage, std::forward<ARGS>(args)...); }
+
+    explicit operator bool() const { return operations != nullptr; }
+
+protected:
+    static constexpr size_t LOCALSIZE = 2 * sizeof(void *);
+
+    struct Operations {
+        R       (*invoke)(void *storage, ARGS &&... args);
+        void    (*move)(void *from, void *to) noexcept;     // leaves from empty
+        void    (*destroy)(void *storage) noexcept;
+    };
+
+    template<class F>
+    static constexpr bool isLocal() {
+        return sizeof(F) <= LOCALSIZE && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+    }
+
+    // blocks for targets that aren't local, over-aligned ones from the global operator new (as PoolAllocator)
+    template<class F>
+    static F *allocate() {
+        if constexpr(alignof(F) > Pool::GRANULARITY) {
+            return static_cast<F *>(::operator new(sizeof(F), std::align_val_t(alignof(F))));
+        } else {
+            return static_cast<F *>(Pool::allocate(sizeof(F)));
+        }
+    }
+
+    template<class F>
+    static void release(F *block) noexcept {
+        if constexpr(alignof(F) > Pool::GRANULARITY) {
+            ::operator delete(block, std::align_val_t(alignof(F)));
+        } else {
+            Pool::release(block, sizeof(F));
+        }
+    }
+
+    template<class F>
+    static F &target(void *storage) {
+        if constexpr(isLocal<F>()) return *std::launder(reinterpret_cast<F *>(storage)); else return **reinterpret_cast<F **>(storage);
+    }
+
+    template<class F>
+    static constexpr Operations OPERATIONS = {
+        [](void *storage, ARGS &&... args) -> R { return target<F>(storage)(std::forward<ARGS>(args)...); },
+        [](void *from, void *to) noexcept {
+            if constexpr(isLocal<F>()) {
+                ::new(to) F(std::move(target<F>(from)));
+                target<F>(from).~F();
+            } else {
+                *reinterpret_cast<F **>(to) = *reinterpret_cast<F **>(from);
+            }
+        },
+        [](void *storage) noexcept {
+            if constexpr(isLocal<F>()) {
+                target<F>(storage).~F();
+            } else {
+                F *function = &target<F>(storage);
+                function->~F();
+                release(function);
+            }
+        }
+    };
+
+    const Operations *                          operations = nullptr;
+    alignas(std::max_align_t) mutable char      storage[LOCALSIZE];  // the target, or a pointer to it
+};
+
+#endif
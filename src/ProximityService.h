@@ -0,0 +1,250 @@
+#ifndef PROXIMITYSERVICE_H
+#define PROXIMITYSERVICE_H
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "Agent.h"
+#include "Channel.h"
+#include "MinkowskiSpace.h"
+#include "UniformGrid.h"
+#include "Velocity.h"
+
+template<class T, Environment ENV> requires std::floating_point<typename ENV::SpaceTime::Time> class ProximityService;
+
+
+// The earliest lab time, not before 'from', at which two agents on linear trajectories come
+// within a (lab frame) spatial distance d of each other, having been further apart.
+// Each trajectory is given as a point on it and its velocity.
+// Returns the maximum Time if the agents never approach within d after 'from'.
+template<class SPACETIME>
+SPACETIME::Time timeOfApproach(const SPACETIME &x1, const Velocity<SPACETIME> &v1, const SPACETIME &x2, const Velocity<SPACETIME> &v2,
+                                typename SPACETIME::Time d, typename SPACETIME::Time from) {
+    typedef typename SPACETIME::Time Time;
+    // lab-frame velocities, with unit time component
+    SPACETIME u1 = v1 * (1/v1.labTime());
+    SPACETIME u2 = v2 * (1/v2.labTime());
+    SPACETIME r0 = (x2 + u2*(from - x2.labTime())) - (x1 + u1*(from - x1.labTime()));
+    SPACETIME w = u2 - u1;
+    Time a = spatialNormSquared(w);
+    Time mb = -spatialDotProduct(r0, w);
+    Time c = spatialNormSquared(r0) - d*d;
+    if(c <= 0 || a == 0) return std::numeric_limits<Time>::max(); // already within d, or not approaching
+    Time sq = mb*mb - a*c;
+    if(sq < 0 || mb <= 0) return std::numeric_limits<Time>::max(); // never within d, or moving apart
+    return from + (mb - sqrt(sq))/a;
+}
+
+
+// Mix-in for agents that are members of a ProximityService.
+// T should be the type of the member, derived from Agent<ENV> and this class, and must have a method
+//     void onProximity(size_t otherMemberId)
+// which is called when the member comes within the service's distance of another member.
+// A member that changes its velocity should call trajectoryChanged() so that the service
+// can re-predict its approaches.
+template<class T, Environment ENV>
+class ProximityMember {
+public:
+    typedef ENV::SpaceTime::Time    Time;
+
+    size_t proximityId() const { return id; }
+
+    // Tells the service this member's new trajectory and cancels
+    // any predicted approaches on its old trajectory.
+    void trajectoryChanged() {
+        T &self = static_cast<T &>(*this);
+        ++version;
+        pairEpochs.clear();
+        toService.send([id = id, position = self.position(), velocity = self.vel](ProximityService<T,ENV> &service) {
+            service.update(id, position, velocity);
+        });
+    }
+
+protected:
+    friend class ProximityService<T,ENV>;
+
+    Channel<ProximityService<T,ENV>>    toService;
+    size_t                              id = 0;
+    uint64_t                            version = 0;        // number of trajectory changes
+    std::unordered_map<size_t,uint64_t> pairEpochs;         // latest prediction for each other member
+
+    // Called by the service to set (or, if labTime is the maximum Time, cancel) the
+    // approach to another member. Predictions made for an old trajectory are ignored.
+    void predictApproach(size_t other, uint64_t trajectoryVersion, uint64_t epoch, Time labTime) {
+        if(trajectoryVersion != version) return;
+        pairEpochs[other] = epoch;
+        if(labTime == std::numeric_limits<Time>::max()) return;
+        T &self = static_cast<T &>(*this);
+        self.callAt(std::max(labTime, self.position().labTime()), [this, other, trajectoryVersion, epoch]() {
+            auto it = pairEpochs.find(other);
+            if(trajectoryVersion != version || it == pairEpochs.end() || it->second != epoch) return;
+            pairEpochs.erase(it);
+            static_cast<T *>(this)->onProximity(other);
+        });
+    }
+};
+
+
+// A ProximityService is an agent that tells its members when they come within a given
+// (lab frame) distance of each other. Members tell the service their trajectory only when
+// it changes, so members needn't message each other to find out who is nearby.
+//
+// The service periodically predicts all approaches within a horizon of lab time by a
+// sweep-and-prune over the first spatial coordinate, costing O(n log n + k) for n members
+// and k candidate pairs, and tells both members of each approaching pair,
+// which then call onProximity() on a timer at the time of approach. When a member's
+// trajectory changes, only that member's approaches are re-predicted, and only against
+// the members near it in a spatial index of where each member was at the start of the last pass.
+// Members move slower than light, so a member that's further away than the distance plus the
+// furthest the two can travel before the end of the window can't approach in time.
+//
+// Predictions are passed on at least half a horizon before the approach unless
+// caused by a recent trajectory change, so if half the horizon is more than the time a lambda
+// takes to get from the service to its members, approaches are called at the exact lab time.
+// Otherwise, a late prediction is called as soon as it is absorbed.
+//
+// T is the type of the members, derived from Agent<ENV> and ProximityMember<T,ENV>
+template<class T, Environment ENV> requires std::floating_point<typename ENV::SpaceTime::Time>
+class ProximityService : public Agent<ENV> {
+public:
+    typedef ENV::SpaceTime          SpaceTime;
+    typedef SpaceTime::Time         Time;
+
+    // Constructed at the position of the current agent, like any other agent.
+    ProximityService(Time distance, Time horizon) : distance(distance), horizon(horizon), index(distance + horizon) {
+        this->callAt(this->position().labTime(), [this]() { predictionPass(); });
+    }
+
+    // Adds an agent at the same position as the service as a member.
+    // Returns the member's id, which is passed to the other member's onProximity().
+    size_t addMember(T &member) {
+        size_t id = tracks.size();
+        tracks.emplace_back(Channel<T>(*this, member), member.position(), member.vel);
+        tracks.back().indexedPosition = positionAt(tracks.back(), indexTime);
+        index.insert(id, tracks.back().indexedPosition);
+        member.toService = Channel<ProximityService<T,ENV>>(member, *this);
+        member.id = id;
+        member.version = 0;
+        return id;
+    }
+
+    // Called by a member when its trajectory changes
+    void update(size_t id, const SpaceTime &position, const Velocity<SpaceTime> &velocity) {
+        Track &track = tracks[id];
+        track.position = position;
+        track.velocity = velocity;
+        ++track.version;
+        for(const auto &[other, epoch] : track.pending) {
+            tracks[other].pending.erase(id);
+            pendingTimes.erase(epoch);
+            sendPrediction(other, id, nextEpoch, std::numeric_limits<Time>::max());
+        }
+        ++nextEpoch;
+        track.pending.clear();
+        Time from = this->position().labTime();
+        Time until = std::max(windowEnd, from);
+        SpaceTime indexedPosition = positionAt(track, indexTime);
+        index.move(id, track.indexedPosition, indexedPosition);
+        track.indexedPosition = indexedPosition;
+        index.forEachNear(indexedPosition, distance + 2*(until - indexTime), [this, id, from, until](size_t other) {
+            if(other != id) predictPair(id, other, from, until);
+        });
+    }
+
+protected:
+    struct Track {
+        Channel<T>                          toMember;
+        SpaceTime                           position;
+        Velocity<SpaceTime>                 velocity;
+        uint64_t                            version = 0;
+        std::unordered_map<size_t,uint64_t> pending;    // epochs of predicted approaches with other members
+        SpaceTime                           indexedPosition; // position on the trajectory at indexTime
+    };
+
+    struct Extent {
+        Time    lo;
+        Time    hi;
+        size_t  id;
+    };
+
+    Time                distance;
+    Time                horizon;
+    Time                windowEnd = 0;      // end of the horizon of the last prediction pass
+    uint64_t            nextEpoch = 1;
+    std::vector<Track>  tracks;
+    UniformGrid<SpaceTime,size_t> index;    // open members, at their positions at indexTime
+    Time                indexTime = 0;      // start of the last prediction pass
+    std::unordered_map<uint64_t,Time> pendingTimes;     // time of approach of each pending epoch
+
+    // Predicts all approaches in the window of lab time [now, now + horizon], then
+    // sets a timer for the next pass half a horizon later.
+    void predictionPass() {
+        Time from = this->position().labTime();
+        Time until = from + horizon;
+        std::vector<Extent> extents;
+        extents.reserve(tracks.size());
+        index.clear();
+        indexTime = from;
+        for(size_t id=0; id<tracks.size(); ++id) {
+            Track &track = tracks[id];
+            if(!track.toMember.isOpen()) continue;
+            track.indexedPosition = positionAt(track, indexTime);
+            index.insert(id, track.indexedPosition);
+            std::erase_if(track.pending, [this, from](const auto &entry) { return pendingTimes.at(entry.second) < from; });
+            if(track.position.labTime() > until) continue;
+            Time x0 = xAt(track, std::max(from, track.position.labTime()));
+            Time x1 = xAt(track, until);
+            extents.push_back({std::min(x0,x1) - distance/2, std::max(x0,x1) + distance/2, id});
+        }
+        std::erase_if(pendingTimes, [from](const auto &entry) { return entry.second < from; });
+        std::sort(extents.begin(), extents.end(), [](const Extent &a, const Extent &b) { return a.lo < b.lo; });
+
+        std::vector<Extent> active;
+        for(const Extent &extent : extents) {
+            std::erase_if(active, [&extent](const Extent &a) { return a.hi < extent.lo; });
+            for(const Extent &a : active) predictPair(a.id, extent.id, from, until);
+            active.push_back(extent);
+        }
+        windowEnd = until;
+        this->callAt(from + horizon/2, [this]() { predictionPass(); });
+    }
+
+    // Predicts the approach of a pair of members in the window [from, until], if it isn't already pending.
+    void predictPair(size_t id1, size_t id2, Time from, Time until) {
+        Track &track1 = tracks[id1];
+        Track &track2 = tracks[id2];
+        if(track1.pending.contains(id2) || !track1.toMember.isOpen() || !track2.toMember.isOpen()) return;
+        from = std::max({from, track1.position.labTime(), track2.position.labTime()});
+        if(from > until) return;
+        Time t = timeOfApproach(track1.position, track1.velocity, track2.position, track2.velocity, distance, from);
+        if(t > until) return;
+        uint64_t epoch = nextEpoch++;
+        track1.pending[id2] = epoch;
+        track2.pending[id1] = epoch;
+        pendingTimes[epoch] = t;
+        sendPrediction(id1, id2, epoch, t);
+        sendPrediction(id2, id1, epoch, t);
+    }
+
+    void sendPrediction(size_t to, size_t other, uint64_t epoch, Time labTime) {
+        tracks[to].toMember.send([other, version = tracks[to].version, epoch, labTime](T &member) {
+            member.predictApproach(other, version, epoch, labTime);
+        });
+    }
+
+    // position of a member at a given lab time, on its current trajectory
+    static SpaceTime positionAt(const Track &track, Time labTime) {
+        return track.position + track.velocity * ((labTime - track.position.labTime()) / track.velocity.labTime());
+    }
+
+    // first spatial coordinate of a member at a given lab time
+    static Time xAt(const Track &track, Time labTime) {
+        return std::get<1>(track.position) + std::get<1>(track.velocity) * (labTime - track.position.labTime()) / track.velocity.labTime();
+    }
+};
+
+#endif
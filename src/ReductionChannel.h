@@ -0,0 +1,129 @@
+#ifndef REDUCTIONCHANNEL_H
+#define REDUCTIONCHANNEL_H
+
+#include <functional>
+#include <optional>
+
+#include "Concepts.h"
+#include "Channel.h"
+#include "FanIn.h"
+#include "predeclarations.h"
+
+template<class T, class VALUE, void (T::*RECEIVE)(VALUE), class COMBINE> class ReductionChannel;
+template<class T, class VALUE, void (T::*RECEIVE)(VALUE), class COMBINE> class Reduction;
+
+
+// The reader end of a Reduction. The lambdas from the sources only add their values to
+// the reduction, so when the target executes a lambda, the lambdas from all sources
+// (including the same source) that are absorbed at the same point are executed with it,
+// and the target then receives their combined value.
+template<class T, class VALUE, void (T::*RECEIVE)(VALUE), class COMBINE>
+class ReductionChannelBuffer : public FanInChannelBuffer<typename T::Environment> {
+public:
+    typedef T::Environment                      ENV;
+    typedef FanInChannelBuffer<ENV>::Time       Time;
+    typedef FanInChannelBuffer<ENV>::LambdaField LambdaField;
+
+    ReductionChannelBuffer(LambdaField field, COMBINE combine) : FanInChannelBuffer<ENV>(std::move(field)), combine(std::move(combine)) { }
+
+    void executeFront(Agent<ENV> &agent) override {
+        Time labTime = agent.position().labTime();
+        Time time;
+        QueueChannelBuffer<ENV> *source = this->next;
+        do {
+            source->executeFront(agent);
+            source->pop();
+        } while((source = this->lambdaAt(agent, labTime, time, nullptr)) != nullptr);
+        isPopped = true;
+        VALUE combined = std::move(*value);
+        value.reset();
+        (static_cast<T &>(agent).*RECEIVE)(std::move(combined));
+    }
+
+    // executeFront has already popped the lambdas it executed
+    void pop() override {
+        if(isPopped) isPopped = false; else this->next->pop();
+    }
+
+protected:
+    friend class ReductionChannel<T,VALUE,RECEIVE,COMBINE>;
+
+    COMBINE                 combine;
+    std::optional<VALUE>    value;      // combined value of the lambdas executed so far at this point
+    bool                    isPopped = false;
+
+    void add(VALUE contribution) {
+        if(value) value = combine(std::move(*value), std::move(contribution)); else value = std::move(contribution);
+    }
+};
+
+
+// A ReductionChannel sends values, rather than lambdas, to a target which receives them
+// by calling RECEIVE on itself. Channels are made by connecting to a Reduction held by the
+// target. Returns false from send() if the channel has been closed at either end.
+template<class T, class VALUE, void (T::*RECEIVE)(VALUE), class COMBINE = std::plus<VALUE>>
+class ReductionChannel {
+public:
+    typedef ReductionChannelBuffer<T,VALUE,RECEIVE,COMBINE> Buffer;
+
+    ReductionChannel() : reduction(nullptr) { }
+
+    ReductionChannel(const ReductionChannel &) = delete;
+    ReductionChannel(ReductionChannel &&) = default;
+    ReductionChannel &operator=(ReductionChannel &&) = default;
+
+    // The lambda is only ever executed by the reduction's buffer, so the buffer still exists then.
+    bool send(VALUE value) {
+        return channel.send([reduction = reduction, value = std::move(value)](T &) mutable {
+            reduction->add(std::move(value));
+        });
+    }
+
+    bool isOpen() const { return channel.isOpen(); }
+
+protected:
+    friend class Reduction<T,VALUE,RECEIVE,COMBINE>;
+
+    ReductionChannel(Channel<T> &&channel, Buffer *reduction) : channel(std::move(channel)), reduction(reduction) { }
+
+    Channel<T>  channel;
+    Buffer *    reduction;
+};
+
+
+// A Reduction is a FanIn for values: sources send values through ReductionChannels and,
+// rather than executing an event per value, the target receives one value for each point
+// at which values are absorbed, combined with COMBINE from all the values absorbed there.
+// e.g. many agents sending sums, maxima or histogram increments to a collector at the same
+// times cost the collector one event per time rather than one per contribution.
+//
+// COMBINE should be associative and commutative, since the values absorbed at the same point
+// can be combined in any order. e.g. std::plus for sums, or a function that merges histograms.
+// Values are only combined when their absorption points are equal, so with a continuous
+// SpaceTime this is for sources that send at the same points, such as on a common timestep.
+//
+// To reduce along a tree, an intermediate agent can hold a Reduction and forward the values it
+// receives to its parent through another ReductionChannel.
+//
+// As for a FanIn, the Reduction is held by the target, e.g. as a member, and the target isn't
+// deleted when all its sources have closed.
+//
+// T is the type of the target, which should be derived from Agent<ENV>
+template<class T, class VALUE, void (T::*RECEIVE)(VALUE), class COMBINE = std::plus<VALUE>>
+class Reduction : public FanIn<T> {
+public:
+    typedef T::Environment                                  Environment;
+    typedef Environment::LambdaField                        LambdaField;
+    typedef ReductionChannelBuffer<T,VALUE,RECEIVE,COMBINE> Buffer;
+
+    Reduction(T &target, COMBINE combine = COMBINE(), LambdaField field = Simulation<Environment>::lambdaField) :
+        FanIn<T>(target, new Buffer(std::move(field), std::move(combine))) { }
+
+    // Create a new channel to the target from a source at the same position as the target.
+    ReductionChannel<T,VALUE,RECEIVE,COMBINE> connect(CallbackChannel<Environment> &source) {
+        Channel<T> channel = FanIn<T>::connect(source);
+        return ReductionChannel<T,VALUE,RECEIVE,COMBINE>(std::move(channel), static_cast<Buffer *>(this->buffer));
+    }
+};
+
+#endif
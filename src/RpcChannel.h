@@ -0,0 +1,128 @@
+#ifndef RPCCHANNEL_H
+#define RPCCHANNEL_H
+
+#include <concepts>
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Concepts.h"
+#include "Channel.h"
+#include "predeclarations.h"
+
+// The channel down which a target replies to the requests of an RpcChannel.
+// This is shared between the caller's end of the RpcChannel and the requests in flight
+// so that it lives as long as there may be replies to send, but it is
+// only ever used by the target.
+template<class C>
+struct ReplyPath {
+    Channel<C>  channel;
+
+    ReplyPath(Channel<C> &&channel) : channel(std::move(channel)) { }
+};
+
+
+// An RpcChannel sends requests from a caller to a target, and carries the
+// target's responses back to the caller over a reply channel that is made once
+// for the pair of agents and reused by every call. As with any channel, while the reply
+// channel is open the caller must block on the target.
+//
+// A call can be made in either of two ways: with a continuation, which is called on the caller
+// when the reply arrives, or, from a coroutine of the caller (see Coroutine.h), by
+//     int result = co_await rpc.call([](Target &target) { return target.value; });
+// which resumes the coroutine with the result when the reply arrives.
+//
+// C is the type of the caller and T the type of the target, both should be derived from Agent<ENV>
+template<class T, class C>
+class RpcChannel {
+public:
+    typedef T::Environment              Environment;
+    typedef Environment::LambdaField    LambdaField;
+
+    RpcChannel() { }
+
+    // create the request and reply channels between two local agents
+    RpcChannel(C &caller, T &target, LambdaField field = Simulation<Environment>::lambdaField) :
+        requests(caller, target, field),
+        replyPath(std::make_shared<ReplyPath<C>>(Channel<C>(target, caller, field))) { }
+
+    // use an existing channel from caller to target, and one from target to caller
+    RpcChannel(Channel<T> &&requestChannel, Channel<C> &&replyChannel) :
+        requests(std::move(requestChannel)),
+        replyPath(std::make_shared<ReplyPath<C>>(std::move(replyChannel))) { }
+
+    RpcChannel(const RpcChannel &) = delete;
+    RpcChannel(RpcChannel &&) = default;
+    RpcChannel &operator=(RpcChannel &&) = default;
+
+    // Sends a request, which is called on the target. The result of the request is sent back
+    // and continuation(caller, result) is called on the caller (or continuation(caller) if the
+    // request returns void). Returns false if the request channel is closed.
+    template<std::invocable<T &> REQUEST, class CONTINUATION>
+    bool call(REQUEST &&request, CONTINUATION &&continuation) {
+        typedef std::invoke_result_t<const std::decay_t<REQUEST> &, T &> Result;
+        return requests.send([replyPath = replyPath, request = std::forward<REQUEST>(request), continuation = std::forward<CONTINUATION>(continuation)](T &target) {
+            if constexpr(std::is_void_v<Result>) {
+                request(target);
+                replyPath->channel.send([continuation](C &caller) {
+                    continuation(caller);
+                });
+            } else {
+                replyPath->channel.send([continuation, result = request(target)](C &caller) {
+                    continuation(caller, result);
+                });
+            }
+        });
+    }
+
+    // Sends a request from a coroutine of the caller, to be awaited. The coroutine is resumed
+    // on the caller, with the request's result, when the reply arrives. Awaiting throws
+    // if the request channel is closed.
+    template<std::invocable<T &> REQUEST>
+    auto call(REQUEST &&request) {
+        typedef std::invoke_result_t<const std::decay_t<REQUEST> &, T &> Result;
+        typedef std::conditional_t<std::is_void_v<Result>, bool, Result> Reply;
+
+        // lives in the suspended coroutine's frame, which is destroyed with the caller,
+        // whose end of the reply channel closes at the same time.
+        struct Awaiter {
+            RpcChannel<T,C> &       rpc;
+            std::decay_t<REQUEST>   request;
+            std::optional<Reply>    reply;
+
+            bool await_ready() const { return false; }
+            bool await_suspend(std::coroutine_handle<> task) {
+                if constexpr(std::is_void_v<Result>) {
+                    return rpc.call(std::move(request), [this, task](C &) {
+                        reply = true;
+                        task.resume();
+                    });
+                } else {
+                    return rpc.call(std::move(request), [this, task](C &, const Result &result) {
+                        reply = result;
+                        task.resume();
+                    });
+                }
+            }
+            Result await_resume() {
+                if(!reply) throw(std::runtime_error("RpcChannel call on a closed channel"));
+                if constexpr(!std::is_void_v<Result>) return std::move(*reply);
+            }
+        };
+        return Awaiter{*this, std::forward<REQUEST>(request), std::nullopt};
+    }
+
+    // Sends a request to which there is no reply.
+    template<std::invocable<T &> REQUEST>
+    bool send(REQUEST &&request) const { return requests.send(std::forward<REQUEST>(request)); }
+
+    bool isOpen() const { return requests.isOpen(); }
+
+protected:
+    Channel<T>                      requests;
+    std::shared_ptr<ReplyPath<C>>   replyPath;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef SERIALIZATION_H
+#define SERIALIZATION_H
+
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+
+// Raw binary serialization, used by snapshots, checkpoints and initial state files.
+// Values are written as their bytes, so should be trivially copyable.
+template<class T> requires std::is_trivially_copyable_v<T>
+void writeRaw(std::ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<class T> requires std::is_trivially_copyable_v<T>
+void readRaw(std::istream &in, T &value) {
+    if(!in.read(reinterpret_cast<char *>(&value), sizeof(T))) throw(std::runtime_error("Unexpected end of binary input"));
+}
+
+
+template<class... COORDS>
+void writeCoordinates(std::ostream &out, const std::tuple<COORDS...> &coords) {
+    std::apply([&out](const COORDS &... coord) { (writeRaw(out, coord), ...); }, coords);
+}
+
+template<class... COORDS>
+void readCoordinates(std::istream &in, std::tuple<COORDS...> &coords) {
+    std::apply([&in](COORDS &... coord) { (readRaw(in, coord), ...); }, coords);
+}
+
+// A position is written as raw bytes if it is trivially copyable, otherwise it should
+// be a tuple of coordinates (e.g. MinkowskiSpace), which are written in turn.
+template<class SPACETIME>
+void writePosition(std::ostream &out, const SPACETIME &position) {
+    if constexpr(std::is_trivially_copyable_v<SPACETIME>) {
+        writeRaw(out, position);
+    } else {
+        writeCoordinates(out, position);
+    }
+}
+
+template<class SPACETIME>
+void readPosition(std::istream &in, SPACETIME &position) {
+    if constexpr(std::is_trivially_copyable_v<SPACETIME>) {
+        readRaw(in, position);
+    } else {
+        readCoordinates(in, position);
+    }
+}
+
+
+// Reading from memory (e.g. a memory-mapped file), which advances the pointer past the value read.
+// The data needn't be aligned.
+template<class T> requires std::is_trivially_copyable_v<T>
+void readRaw(const char *&data, T &value) {
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+}
+
+template<class... COORDS>
+void readCoordinates(const char *&data, std::tuple<COORDS...> &coords) {
+    std::apply([&data](COORDS &... coord) { (readRaw(data, coord), ...); }, coords);
+}
+
+template<class SPACETIME>
+void readPosition(const char *&data, SPACETIME &position) {
+    if constexpr(std::is_trivially_copyable_v<SPACETIME>) {
+        readRaw(data, position);
+    } else {
+        readCoordinates(data, position);
+    }
+}
+
+
+// The number of bytes writePosition() writes
+template<class... COORDS>
+constexpr size_t coordinatesSize(const std::tuple<COORDS...> *) { return (sizeof(COORDS) + ...); }
+
+template<class SPACETIME>
+constexpr size_t positionSize() {
+    if constexpr(std::is_trivially_copyable_v<SPACETIME>) {
+        return sizeof(SPACETIME);
+    } else {
+        return coordinatesSize(static_cast<const SPACETIME *>(nullptr));
+    }
+}
+
+#endif
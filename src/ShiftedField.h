@@ -1,53 +1,47 @@
 #ifndef SHIFTEDFIELD_H
 #define SHIFTEDFIELD_H
 
+#include <stdexcept>
+
 #include "Concepts.h"
 #include "Velocity.h"
-
-// template<StaticDifferentiableField STATICFIELD> class ShiftedField {};
-
-
-// template<StaticFirstOrderField STATICFIELD>
-// class ShiftedField<STATICFIELD> {
-// public:
-//     typedef STATICFIELD::SpaceTime SpaceTime;
-
-//     SpaceTime origin;
-//     ShiftedField(SpaceTime x = SpaceTime()) : origin(std::move(x)) {}
-
-//     auto operator ()(const SpaceTime &pos) const { return STATICFIELD::value(pos-origin); }
-//     template<class VELOCITY>
-//     static typename SpaceTime::Scalar d_dt(const VELOCITY &vel) { return STATICFIELD::d_dt(vel); }
-// };
-
-
-// template<StaticSecondOrderField STATICFIELD>
-// class ShiftedField<STATICFIELD> {
-// public:
-//     typedef STATICFIELD::SpaceTime SpaceTime;
-
-//     SpaceTime origin;
-//     ShiftedField(SpaceTime x = SpaceTime()) : origin(std::move(x)) {}
-
-//     auto operator ()(const SpaceTime &pos) const { return STATICFIELD::value(pos-origin); }
-//     auto d_dt(const SpaceTime &pos, const SpaceTime &vel) const { return STATICFIELD::d_dt(pos-origin, vel); }
-//     template<class VELOCITY>
-//     static auto d2_dt2(const VELOCITY &vel) { return STATICFIELD::d2_dt2(vel); }
-// };
-
-
-// template<StaticHigherOrderField STATICFIELD>
-// class ShiftedField<STATICFIELD> {
-// public:
-//     typedef STATICFIELD::SpaceTime SpaceTime;
-
-//     SpaceTime origin;
-//     ShiftedField(SpaceTime x = SpaceTime()) : origin(std::move(x)) {}
-
-//     auto operator ()(const SpaceTime &pos) const { return STATICFIELD::value(pos-origin); }
-//     auto d_dt(const SpaceTime &pos, const SpaceTime &vel) const { return STATICFIELD::d_dt(pos-origin, vel); }
-//     auto d2_dt2(const SpaceTime &pos, const SpaceTime &vel) const { return STATICFIELD::d2_dt2(pos-origin, vel); }
-// };
+#include "TranslatedField.h"
+
+/// @brief A ShiftedField is a field of the form F(X) = FIELD(X - R) for some constant vector R.
+/// When used as a lambda field, R is the offset between the point of emission and the
+/// apex of the field, so with FIELD = InnerProdField<SPACETIME,c> this gives the lambda field
+/// (X-R).(X-R) - c described in the README. 
+///
+/// By default R = (ReactionTime,0,0,...), i.e. a minimum reaction time in the lab frame.
+/// A lambda can't be absorbed until at least ReactionTime after it was emitted, so agents
+/// can run this far ahead of their sources before blocking.
+///
+/// In Minkowski space, if R is in the future light-cone of the origin then the blocking field
+/// is the same as the lambda field (see README), so a ShiftedField can be used as an
+/// environment's LambdaField without change to the blocking calculation. Any other shift
+/// would give the wrong blocking field, so the constructors throw if R isn't in the
+/// (closed) future light-cone, i.e. if R.R < 0 or R's lab time is negative.
+template<DifferentiableField FIELD, typename FIELD::SpaceTime::Time ReactionTime = typename FIELD::SpaceTime::Time()>
+class ShiftedField : public TranslatedField<FIELD> {
+public:
+    typedef FIELD::SpaceTime SpaceTime;
+
+    ShiftedField() : ShiftedField(SpaceTime(ReactionTime)) { }
+    ShiftedField(SpaceTime shift) : TranslatedField<FIELD>(checkShift(std::move(shift))) { }
+
+    const SpaceTime &shift() const { return this->origin; }
+
+protected:
+    static SpaceTime checkShift(SpaceTime shift) {
+        if(shift*shift < 0 || shift.labTime() < 0) throw(std::runtime_error("A ShiftedField's shift must be in the future light-cone"));
+        return shift;
+    }
+};
+
+// Translating a ShiftedField gives a TranslatedField of the underlying field whose
+// origin is the sum of the shift and the translation.
+template<DifferentiableField FIELD, typename FIELD::SpaceTime::Time ReactionTime>
+TranslatedField(ShiftedField<FIELD,ReactionTime> field, typename FIELD::SpaceTime translation) -> TranslatedField<FIELD>;
 
 
 #endif
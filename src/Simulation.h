@@ -2,6 +2,9 @@
 #define SIMULATION_H
 
 #include "predeclarations.h"
+#include "numerics.h"
+
+#include <stdexcept>
 
 // Given an environment, a Simulation<ENV> is a convenient place to put anything that all agents
 // need access to...i.e. any data that pertains to the simulation as a whole.
@@ -10,22 +13,58 @@ class Simulation {
 public:
     typedef ENV::SpaceTime  SpaceTime;
 
-    static inline typename ENV::LambdaField     lambdaField;// field associated with lambda functions
+    // The lab time of the initialising agent. This is far enough in the past that all
+    // positions are in its future, but close enough that the square of any displacement
+    // from it doesn't overflow when time is integer.
+    static SpaceTime::Time beginningOfTime() {
+        if constexpr(std::integral<typename SpaceTime::Time>) {
+            return -isqrt(std::numeric_limits<typename SpaceTime::Time>::max())/2;
+        } else {
+            return -sqrt(std::numeric_limits<typename SpaceTime::Time>::max());
+        }
+    }
+
+    static inline typename ENV::LambdaField     lambdaField;// default field associated with lambda functions (each channel can have its own)
     static inline typename ENV::Boundary        boundary;   // field that defines the boundary
     static inline typename ENV::Executor        executor;   // task executor. Non-static so we can clean up in destructor
-    static inline SourceAgent<ENV>              mainThread =  SourceAgent<ENV>(SpaceTime(-sqrt(std::numeric_limits<typename SpaceTime::Time>::max()))); // Agent on which the main thread notionally runs
+    static inline SourceAgent<ENV>              mainThread =  SourceAgent<ENV>(SpaceTime(beginningOfTime())); // Agent on which the main thread notionally runs
     static inline thread_local SourceAgent<ENV> *currentThreadAgent = &mainThread; // each thread has an active agent on which it is currently running
+    static inline bool                          isPaused = false; // whether the boundary may be moved on (see runUntil), so agents that reach it are kept
     
 
+    // The lambda field of an agent at a given position. If the lambda field is a ShiftedField
+    // the shift is folded into the origin of the translated field.
     typedef decltype(TranslatedField(lambdaField, std::declval<SpaceTime>())) TranslatedLambdaField;
+    // For lambda fields of the form (X-R).(X-R) - c in Minkowski space, with R in the future light-cone
+    // and c >= 0, the blocking field is the lambda field (see README).
     typedef TranslatedLambdaField TranslatedBlockingField;
 
     // Call this to start the simulation after creating initial agents.
     static void start() {
+        isPaused = false;
         mainThread.advanceBy(mainThread.timeToIntersection(Simulation<ENV>::boundary));
         executor.join();
     }
 
+    // Moves the boundary to a later lab time and runs the simulation up to it. Unlike start(), this returns with
+    // all agents and channels still alive and blocked on the boundary, so the simulation can be inspected
+    // (or checkpointed) and then run further. The boundary should be a LabTimeBoundary and the executor
+    // should have a wait() method that waits for all tasks to finish without stopping the executor.
+    // Agents with no inChannels or timers are kept while paused, and are deleted once start() is called.
+    static void runUntil(SpaceTime::Time labTime) {
+        if(labTime < boundary.labTime) throw(std::runtime_error("Attempt to move the boundary into the past"));
+        boundary.labTime = labTime;
+        resume();
+    }
+
+    // Runs the simulation up to the boundary, wherever it currently is, and waits
+    // until all agents have reached it.
+    static void resume() {
+        isPaused = true;
+        mainThread.advanceBy(mainThread.timeToIntersection(Simulation<ENV>::boundary));
+        executor.wait();
+    }
+
 };
 
 #endif
@@ -0,0 +1,219 @@
+#ifndef SNAPSHOTS_H
+#define SNAPSHOTS_H
+
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Agent.h"
+#include "LabTimeBoundary.h"
+#include "Serialization.h"
+
+// The state of one agent in a snapshot, written by a user-supplied serializer.
+// Values are written as raw bytes, so should be trivially copyable.
+class SnapshotRecord {
+public:
+    template<class T> requires std::is_trivially_copyable_v<T>
+    void write(const T &value) { write(&value, sizeof(T)); }
+
+    void write(const void *data, size_t size) {
+        const char *bytes = static_cast<const char *>(data);
+        payload.insert(payload.end(), bytes, bytes + size);
+    }
+
+protected:
+    template<Environment ENV> friend class Snapshots;
+
+    std::vector<char> payload;
+};
+
+
+// Reads back a record's payload in the order it was written.
+class SnapshotPayload {
+public:
+    SnapshotPayload(std::span<const char> data) : data(data) { }
+
+    template<class T> requires std::is_trivially_copyable_v<T>
+    T read() {
+        if(offset + sizeof(T) > data.size()) throw(std::runtime_error("Attempt to read past the end of a snapshot record"));
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    size_t remaining() const { return data.size() - offset; }
+
+protected:
+    std::span<const char>   data;
+    size_t                  offset = 0;
+};
+
+
+// Snapshots of the state of agents on a sequence of cuts through spacetime, at lab times
+//     firstCut, firstCut + interval, firstCut + 2*interval, ...
+// i.e. hyperplanes of the LabTimeField. An agent that is followed calls its serializer when its
+// trajectory crosses each cut, from a timer on the agent (see Agent::callAt), so taking a snapshot
+// never makes an agent block. The lambdas an agent absorbs before the cut are executed before
+// its state is captured, those after the cut are not, so each snapshot is a consistent cut
+// of the simulation.
+//
+// Each thread writes its own file through a large buffer, so threads never wait for
+// each other, and a thread only waits for the file system when its buffer is full.
+// The files are only complete once flush() is called, or this is destroyed. Agents may still be
+// followed when this is destroyed, their remaining captures are then cancelled.
+// The files are named <prefix>.<n> and each is a sequence of records of the form
+//     [uint64 cut index][coordinates of the agent's position][uint32 payload size][payload]
+// which can be read with forEachRecord().
+template<Environment ENV>
+class Snapshots {
+public:
+    typedef ENV::SpaceTime          SpaceTime;
+    typedef ENV::SpaceTime::Time    Time;
+
+    static constexpr size_t BUFFERSIZE = 1 << 16;   // bytes each thread buffers before writing
+
+    Snapshots(std::string filePrefix, Time firstCut, Time interval, uint64_t nCuts = std::numeric_limits<uint64_t>::max()) :
+        prefix(std::move(filePrefix)), firstCut(firstCut), interval(interval), nCuts(nCuts), serialNumber(nextSerialNumber++),
+        self(std::make_shared<Snapshots<ENV> *>(this)) {
+        if(!(interval > 0)) throw(std::runtime_error("Snapshot interval must be positive"));
+    }
+
+    Snapshots(const Snapshots &) = delete;
+
+    // Cancels the captures still to come and writes out what's left in all threads' buffers.
+    // Like flush(), this shouldn't be called while the simulation is running.
+    ~Snapshots() {
+        *self = nullptr;
+        flush();
+    }
+
+    // Writes out what's left in all threads' buffers, so that the files hold every capture so far.
+    // This should be called while the simulation isn't running (e.g. after runUntil() has returned).
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(std::unique_ptr<Writer> &writer : writers) {
+            if(!writer->out.flush()) throw(std::runtime_error("Can't write snapshot file " + writer->fileName));
+        }
+    }
+
+    // Captures the state of an agent, as serialize(const T &agent, SnapshotRecord &record), on each cut
+    // from its current position onward. This should be called on the agent's thread (e.g. by the agent's
+    // constructor or by the agent before the simulation starts).
+    template<std::derived_from<Agent<ENV>> T, std::invocable<const T &, SnapshotRecord &> SERIALIZE>
+    void follow(T &agent, SERIALIZE serialize) {
+        Time now = agent.position().labTime();
+        uint64_t cut = (now <= firstCut ? 0 : cutAfter(now));
+        if(cut < nCuts) scheduleCapture(agent, cut, std::move(serialize));
+    }
+
+    // The lab time of a cut
+    Time cutTime(uint64_t cut) const { return firstCut + interval * static_cast<Time>(cut); }
+
+    // The names of the files written so far.
+    std::vector<std::string> files() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> names;
+        for(std::unique_ptr<Writer> &writer : writers) names.push_back(writer->fileName);
+        return names;
+    }
+
+    // Calls f(cut, position, SnapshotPayload) for each record in a snapshot file, in the order it was written.
+    template<std::invocable<uint64_t, const SpaceTime &, SnapshotPayload &> F>
+    static void forEachRecord(const std::string &fileName, F &&f) {
+        std::ifstream in(fileName, std::ios::binary);
+        if(!in) throw(std::runtime_error("Can't open snapshot file " + fileName));
+        uint64_t cut;
+        SpaceTime position;
+        uint32_t size;
+        std::vector<char> payload;
+        while(in.peek() != std::ifstream::traits_type::eof()) {
+            readRaw(in, cut);
+            readPosition(in, position);
+            readRaw(in, size);
+            payload.resize(size);
+            if(!in.read(payload.data(), size)) throw(std::runtime_error("Truncated record in snapshot file " + fileName));
+            SnapshotPayload reader(payload);
+            f(cut, position, reader);
+        }
+    }
+
+protected:
+    // A thread's file, with a large buffer
+    struct Writer {
+        std::string         fileName;
+        std::vector<char>   buffer;
+        std::ofstream       out;
+
+        Writer(std::string name) : fileName(std::move(name)), buffer(BUFFERSIZE) {
+            out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            out.open(fileName, std::ios::binary);
+            if(!out) throw(std::runtime_error("Can't open snapshot file " + fileName));
+        }
+    };
+
+    static inline std::atomic<uint64_t> nextSerialNumber = 0;
+
+    std::string                             prefix;
+    Time                                    firstCut;
+    Time                                    interval;
+    uint64_t                                nCuts;
+    uint64_t                                serialNumber;   // identifies this in the threads' writer tables
+    std::mutex                              mutex;
+    std::vector<std::unique_ptr<Writer>>    writers;
+    std::shared_ptr<Snapshots<ENV> *>       self;           // shared with the capture timers, null once this is destroyed
+
+    // first cut strictly after a lab time
+    uint64_t cutAfter(Time labTime) const {
+        uint64_t cut = static_cast<uint64_t>((labTime - firstCut) / interval);
+        while(cutTime(cut) <= labTime) ++cut;
+        return cut;
+    }
+
+    template<class T, class SERIALIZE>
+    void scheduleCapture(T &agent, uint64_t cut, SERIALIZE &&serialize) {
+        agent.callAt(cutTime(cut), [self = self, &agent, cut, serialize = std::forward<SERIALIZE>(serialize)]() mutable {
+            Snapshots<ENV> *snapshots = *self;
+            if(snapshots == nullptr) return;
+            snapshots->capture(agent, cut, serialize);
+            if(cut + 1 < snapshots->nCuts) snapshots->scheduleCapture(agent, cut + 1, std::move(serialize));
+        });
+    }
+
+    template<class T, class SERIALIZE>
+    void capture(const T &agent, uint64_t cut, SERIALIZE &serialize) {
+        static thread_local SnapshotRecord record;
+        record.payload.clear();
+        serialize(agent, record);
+        std::ofstream &out = threadWriter().out;
+        writeRaw(out, cut);
+        writePosition(out, agent.position());
+        writeRaw(out, static_cast<uint32_t>(record.payload.size()));
+        out.write(record.payload.data(), record.payload.size());
+    }
+
+    // This thread's writer, which is made on the thread's first capture
+    Writer &threadWriter() {
+        static thread_local std::unordered_map<uint64_t, Writer *> threadWriters;
+        Writer *&writer = threadWriters[serialNumber];
+        if(writer == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex);
+            writers.push_back(std::make_unique<Writer>(prefix + "." + std::to_string(writers.size())));
+            writer = writers.back().get();
+        }
+        return *writer;
+    }
+};
+
+#endif
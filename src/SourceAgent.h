@@ -1,42 +1,93 @@
 #ifndef CALLBACKQUEUE_H
 #define CALLBACKQUEUE_H
 
+#include <algorithm>
 #include <functional>
 #include <atomic>
+#include <deque>
+#include <utility>
+#include <vector>
 
 #include "Concepts.h"
 #include "ThreadSafeQueue.h"
+#include "ThreadPool.h"
+#include "Pool.h"
 #include "TranslatedField.h"
 #include "Velocity.h"
 #include "predeclarations.h"
 #include "numerics.h"
+#include "Log.h"
 
 template<Environment ENV>
 class CallbackQueue  {
 public:
+    typedef std::deque<Agent<ENV> *, PoolAllocator<Agent<ENV> *>> AgentDeque;
 
     ~CallbackQueue() {
         if(!isTriggered) trigger();
     }
 
+    // isTriggered is checked with the lock held, otherwise an agent pushed while the
+    // queue is being triggered can miss the trigger and never be called back.
     void push(Agent<ENV> *agent) {
+        mutex.lock();
         if(isTriggered) {
+            mutex.unlock();
             execCallback(agent);
         } else {
-            mutex.lock();
             buffer.push_back(agent);
             mutex.unlock();
         }
     }
 
+    // Whether the agents on this queue have been called back
+    bool triggered() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return isTriggered;
+    }
+
+    // Takes an agent off the queue without calling it back, e.g. when it is to be
+    // run by something else. Returns false if the agent wasn't on the queue.
+    // Searches from the back, as it's usually the agent most recently pushed.
+    bool remove(Agent<ENV> *agent) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(buffer.rbegin(), buffer.rend(), agent);
+        if(it == buffer.rend()) return false;
+        buffer.erase(std::next(it).base());
+        return true;
+    }
+
+    // Takes all the agents off the queue without calling them back, in the order they were pushed.
+    AgentDeque takeAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::exchange(buffer, AgentDeque());
+    }
+
+    // Pushes agents in order, taking the lock once (e.g. agents constructed in bulk, see BulkConstruction)
+    void pushAll(AgentDeque &&agents) {
+        mutex.lock();
+        if(isTriggered) {
+            mutex.unlock();
+            for(Agent<ENV> *agent : agents) execCallback(agent);
+        } else {
+            if(buffer.empty()) {
+                buffer = std::move(agents);
+            } else {
+                buffer.insert(buffer.end(), agents.begin(), agents.end());
+            }
+            mutex.unlock();
+        }
+    }
+
 
 protected:
-    std::deque<Agent<ENV> *>   buffer;
+    AgentDeque      buffer;
     std::mutex      mutex;
     bool isTriggered = false;
 
     friend class SourceAgent<ENV>;
     friend class CallbackChannel<ENV>;
+    friend class Checkpoint<ENV>;
 
     void trigger() {
         mutex.lock();
@@ -48,45 +99,87 @@ protected:
         }
     }
 
-    // deletes all the agents on the callback queue
+    // Deletes all the agents on the callback queue, at the end of the simulation.
+    // Agents are deleted in turn on this thread, except those whose hasThreadSafeDestructor() returns true,
+    // which are then deleted in parallel, on threads of their own as the executor may have been joined. Agents that are called back
+    // while this is happening (e.g. when a channel they're blocked on is closed) aren't run, as the
+    // simulation is over, but are deleted in the next round.
     void deleteCallbackAgents() {
         mutex.lock();
         isTriggered = true;
         mutex.unlock();
+        WokenAgents woken;  // local, as this runs during static destruction
+        wokenAgents.store(&woken, std::memory_order_release);
         while(!buffer.empty()) {
-            std::cout << "Deleting agent " << buffer.front() << " from boundaryAgent callbacks" << std::endl;
-            delete(buffer.front());
-            buffer.pop_front();
+            deleteAll(buffer);
+            buffer.clear();
+            std::lock_guard<std::mutex> lock(woken.mutex);
+            std::swap(buffer, woken.agents);
         }
+        wokenAgents.store(nullptr, std::memory_order_release);
+        Log::flush(); // this is called at exit, when a log buffer made now would never be flushed
     }
 
-    inline static void execCallback(Agent<ENV> *agent) {
-        Simulation<ENV>::executor.submit([agent]() {
-            agent->step();
+    static void deleteAll(const AgentDeque &agents) {
+        std::vector<Agent<ENV> *> parallelAgents;
+        for(Agent<ENV> *agent : agents) {
+            if(agent->hasThreadSafeDestructor()) parallelAgents.push_back(agent); else deleteCallbackAgent(agent);
+        }
+        parallelFor(parallelAgents.size(), TEARDOWNCHUNK, [&parallelAgents](size_t begin, size_t end) {
+            for(size_t agent = begin; agent < end; ++agent) deleteCallbackAgent(parallelAgents[agent]);
         });
     }
+
+    static void deleteCallbackAgent(Agent<ENV> *agent) {
+        Log::write<LogLevel::Debug>("Deleting agent ", agent, " from boundaryAgent callbacks");
+        delete(agent);
+    }
+
+    static constexpr size_t TEARDOWNCHUNK = 4096; // minimum number of agents per teardown thread
+
+    // agents called back during teardown
+    struct WokenAgents {
+        std::mutex                  mutex;
+        AgentDeque                  agents;
+    };
+    static inline std::atomic<WokenAgents *> wokenAgents = nullptr; // non-null during teardown
+
+    inline static void execCallback(Agent<ENV> *agent) {
+        if(WokenAgents *woken = wokenAgents.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(woken->mutex);
+            woken->agents.push_back(agent);
+            return;
+        }
+        if constexpr(requires { Simulation<ENV>::executor.submit(agent->homeNode(), []() { }); }) {
+            Simulation<ENV>::executor.submit(agent->homeNode(), [agent]() { // an executor with a queue per NUMA node
+                agent->step();
+            });
+        } else {
+            Simulation<ENV>::executor.submit([agent]() {
+                agent->step();
+            });
+        }
+    }
 };
 
 
+// A CallbackField is the callback queue of an agent at a fixed position.
+// Each channel has its own lambda field, so the lambda and blocking fields
+// are found by translating the channel's field to this position.
 template<Environment ENV>
 class CallbackField : public CallbackQueue<ENV> {
 protected:
-    typedef Simulation<ENV>::TranslatedLambdaField TranslatedLambdaField;
-
-    const TranslatedLambdaField lambdaField;
+    const ENV::SpaceTime        position;
 
 public:
-    CallbackField() = default;
-    CallbackField(TranslatedLambdaField field) : lambdaField(std::move(field)) {}
-    CallbackField(ENV::SpaceTime origin) : lambdaField(Simulation<ENV>::lambdaField, std::move(origin)) { }
-
+    CallbackField(ENV::SpaceTime origin) : position(std::move(origin)) { }
 
-    // timeToBlocking(pos, vel)
+    // Since the position is const, we don't care about locking or which thread we're on.
+    const auto &asPosition() const { return position; }           // used for calculating trajectories and spawning new agents
 
-    // Since the fields are const, we don't care about locking or which thread we're on.
-    const auto &asBlockingField() const { return lambdaField; }   // used for blocking other agents
-    const auto &asLambdaField() const { return lambdaField; }     // used for sending lambdas
-    const auto &asPosition() const { return lambdaField.origin; } // used for calculating trajectories and spawning new agents
+    // used for sending lambdas and blocking other agents on a channel with the given lambda field
+    template<DifferentiableField FIELD>
+    auto translate(const FIELD &lambdaField) const { return TranslatedField(lambdaField, position); }
 };
 
 
@@ -101,20 +194,24 @@ class CallbackChannel {
 public:
 
     CallbackChannel(typename ENV::SpaceTime position) {
-        pCallbackBuffer = std::make_shared<CallbackField<ENV>>(std::move(position));
+        pCallbackBuffer = std::allocate_shared<CallbackField<ENV>>(PoolAllocator<CallbackField<ENV>>(), std::move(position));
     }
 
     CallbackChannel(const CallbackChannel<ENV> &other) : CallbackChannel(other.pCallbackBuffer->asPosition()) { }
 
+    // use an existing callback field (e.g. one that isn't reference counted)
+    CallbackChannel(std::shared_ptr<CallbackField<ENV>> callbackField) : pCallbackBuffer(std::move(callbackField)) { }
+
     ~CallbackChannel() {
         if(this == &Simulation<ENV>::mainThread) pCallbackBuffer->deleteCallbackAgents();
     }
 
 
     // to be called from the channel, on the source thread when sending a lambda, so no need for atomic ref
-    const auto &asLambdaField() const {
+    template<DifferentiableField FIELD>
+    auto asLambdaField(const FIELD &lambdaField) const {
         assert(Simulation<ENV>::currentThreadAgent->hasAuthorityOver(this)); // check this thread has authority over this agent
-        return pCallbackBuffer->asLambdaField();
+        return pCallbackBuffer->translate(lambdaField);
     }
 
     // A Channel should call this to determine the blocking field.
@@ -127,6 +224,10 @@ public:
         return copyOfPtr;
     }
 
+    // Releases the agents blocked on the current position, e.g. when
+    // a stub source hands over to a real source.
+    void releaseCallbacks() { pCallbackBuffer->trigger(); }
+
     // An agent has authority over itself and all the agents in its callback buffer.
     bool hasAuthorityOver(const CallbackChannel<ENV> *agent) const {
         if(agent == this) return true;
@@ -158,20 +259,27 @@ public:
 
     using CallbackChannel<ENV>::pCallbackBuffer;
 
-    // To be called by the source agent
+    // To be called by the source agent.
+    // The new field is swapped in before the old one is triggered, so an agent that
+    // is called back can't read the old field again and be called straight back.
     void updatePosition(const SpaceTime &newPosition) {
-        pCallbackBuffer->trigger();
-        std::shared_ptr<CallbackField<ENV>> newBuffer = std::make_shared<CallbackField<ENV>>(newPosition);
+        std::shared_ptr<CallbackField<ENV>> newBuffer = std::allocate_shared<CallbackField<ENV>>(PoolAllocator<CallbackField<ENV>>(), newPosition);
         this->mutex.lock();
-        pCallbackBuffer = std::move(newBuffer);
+        std::swap(pCallbackBuffer, newBuffer);
         this->mutex.unlock();
+        newBuffer->trigger();
     }
 
     void advanceBy(Time time) { updatePosition(position() + vel * time); }
     
+    // When time is integer, the intersection is the first integer time at which the field is non-negative
     template<FirstOrderField F>
     Time timeToIntersection(const F &field) const {
-        return -field(position())/field.d_dt(vel); // should be valid integer division when time is integer
+        if constexpr(std::integral<Time>) {
+            return ceilDiv<Time>(-field(position()), field.d_dt(vel));
+        } else {
+            return -field(position())/field.d_dt(vel);
+        }
     }
 
 
@@ -183,7 +291,12 @@ public:
         if constexpr(std::floating_point<Time>) sq += delta(sq); // ensure we don't round into negative
         if(sq < 0) return std::numeric_limits<Time>::max(); // never intersects
 
-        return (mb + sqrt(sq))/a;
+        if constexpr(std::integral<Time>) {
+            // smallest integer t such that at - mb >= sqrt(sq), exact so no need for the delta above
+            return ceilDiv<Time>(mb + isqrtCeil<Time>(sq), a);
+        } else {
+            return (mb + sqrt(sq))/a;
+        }
     }
 
     Velocity<SpaceTime>                 vel;
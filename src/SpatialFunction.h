@@ -1,8 +1,8 @@
 #ifndef SPATIALFUNCTION_H
 #define SPATIALFUNCTION_H
 
-#include <functional>
 #include "Concepts.h"
+#include "Pool.h"
 #include "predeclarations.h"
 
 /// @brief A SpatialFunction is a lambda function that fills a subset E of spacetime,
@@ -12,12 +12,12 @@
 /// @tparam ENV The environment whose agents this lambda takes as argument
 /// @tparam FIELD The Field of this lambda, should be constructibe from the position of the emitting agent,
 template<class ENV, DifferentiableField FIELD>
-class SpatialFunction : public std::function<void(Agent<ENV> &)> {
+class SpatialFunction : public PooledFunction<void(Agent<ENV> &)> {
 public:
 
     template<class F, class LAMBDA>
     SpatialFunction(F &&field, LAMBDA &&lambda) : 
-        std::function<void(Agent<ENV> &)>(std::forward<LAMBDA>(lambda)),
+        PooledFunction<void(Agent<ENV> &)>(std::forward<LAMBDA>(lambda)),
         field(std::forward<F>(field)) { }
 
     const FIELD &asField() { return field; }
@@ -1,14 +1,24 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <thread>
+#include <utility>
+#include <future>
+#include <functional>
 #include <boost/asio.hpp>
 #include <queue>
+#include <vector>
 #include <iostream>
 
+#include "Numa.h"
+
 template<uint NTHREADS>
 class ThreadPool {
 protected:
     boost::asio::thread_pool pool;
+    std::atomic<size_t>     nPending = 0; // submitted tasks that haven't finished
 
 public:
     ThreadPool() : pool(NTHREADS) {}
@@ -17,9 +27,15 @@ public:
         pool.join();
     }
 
+    // A task that submits other tasks does so before it finishes, so
+    // nPending only reaches zero when there's nothing left to run.
     template<class T>
     void submit(T &&runnable) {
-        boost::asio::post(pool,std::forward<T>(runnable));
+        nPending.fetch_add(1, std::memory_order_relaxed);
+        boost::asio::post(pool, [this, runnable = std::forward<T>(runnable)]() mutable {
+            runnable();
+            if(nPending.fetch_sub(1, std::memory_order_acq_rel) == 1) nPending.notify_all();
+        });
     }
 
     template<class FUNC, class RTN>
@@ -30,6 +46,80 @@ public:
     void join() {
         pool.join();
     }
+
+    // Waits until all tasks have finished, but leaves the pool running so more can be submitted.
+    void wait() {
+        size_t n;
+        while((n = nPending.load(std::memory_order_acquire)) != 0) nPending.wait(n);
+    }
+};
+
+
+// A pool of NTHREADS workers, each pinned to a core, spread evenly over the NUMA nodes (see Numa).
+// Each node has a queue of its own, and a task is run by a worker on the node it was submitted to,
+// so an agent, whose memory is on its home node, is stepped by workers on that node (see Agent::setHomeNode).
+// Without a node, a task is run on the node of the thread that submits it.
+// On a machine with one node this is a thread pool whose workers are pinned to cores.
+template<uint NTHREADS>
+class NumaThreadPool {
+protected:
+    std::vector<boost::asio::io_context>    queues;     // by node
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> workGuards;
+    std::vector<std::thread>                workers;
+    std::atomic<size_t>                     nPending = 0; // submitted tasks that haven't finished
+
+public:
+    static_assert(NTHREADS > 0, "A NumaThreadPool needs at least one worker");
+
+    NumaThreadPool() : queues(std::min<size_t>(Numa::nNodes(), NTHREADS)) {
+        for(boost::asio::io_context &queue : queues) workGuards.push_back(boost::asio::make_work_guard(queue));
+        for(size_t worker = 0; worker < NTHREADS; ++worker) {
+            size_t node = worker % queues.size();
+            const std::vector<int> &cpus = Numa::cpusOfNode(node);
+            int cpu = cpus[(worker / queues.size()) % cpus.size()];
+            workers.emplace_back([queue = &queues[node], cpu, node]() {
+                Numa::pinToCpu(cpu, node);
+                queue->run();
+            });
+        }
+    }
+
+    ~NumaThreadPool() {
+        join();
+    }
+
+    size_t nNodes() const { return queues.size(); }
+
+    template<class T>
+    void submit(T &&runnable) {
+        submit(Numa::currentNode(), std::forward<T>(runnable));
+    }
+
+    // A task that submits other tasks does so before it finishes, so
+    // nPending only reaches zero when there's nothing left to run.
+    template<class T>
+    void submit(size_t node, T &&runnable) {
+        nPending.fetch_add(1, std::memory_order_relaxed);
+        boost::asio::post(queues[node % queues.size()], [this, runnable = std::forward<T>(runnable)]() mutable {
+            runnable();
+            if(nPending.fetch_sub(1, std::memory_order_acq_rel) == 1) nPending.notify_all();
+        });
+    }
+
+    // Waits for all tasks to finish, then stops the workers
+    void join() {
+        if(workers.empty()) return;
+        wait();
+        workGuards.clear();
+        for(std::thread &worker : workers) worker.join();
+        workers.clear();
+    }
+
+    // Waits until all tasks have finished, but leaves the pool running so more can be submitted.
+    void wait() {
+        size_t n;
+        while((n = nPending.load(std::memory_order_acquire)) != 0) nPending.wait(n);
+    }
 };
 
 
@@ -53,6 +143,39 @@ public:
         }
 //        std::cout << "Done" << std::endl;
     }
+
+    void wait() { join(); }
 };
 
+
+// Calls f(begin, end) on contiguous slices of the range [0, nItems), on up to one thread per core, with
+// at least minPerThread items per thread. This is for work outside the simulation (e.g. setting up
+// and tearing down agents) so uses threads of its own, as the executor may not be running.
+// On a NUMA machine, the threads are spread evenly over the nodes, so what they allocate is too (see Pool).
+// Returns once all slices are done, rethrowing the first exception thrown by any slice.
+template<class F>
+void parallelFor(size_t nItems, size_t minPerThread, F &&f) {
+    size_t nThreads = std::min<size_t>(std::thread::hardware_concurrency(), nItems / std::max<size_t>(minPerThread, 1));
+    if(nThreads <= 1) {
+        f(size_t(0), nItems);
+        return;
+    }
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> exceptions(nThreads);
+    for(size_t i = 0; i < nThreads; ++i) {
+        threads.emplace_back([&f, &exception = exceptions[i], begin = nItems * i / nThreads, end = nItems * (i + 1) / nThreads, node = i * Numa::nNodes() / nThreads]() {
+            if(Numa::nNodes() > 1) Numa::pinToNode(node);
+            try {
+                f(begin, end);
+            } catch(...) {
+                exception = std::current_exception();
+            }
+        });
+    }
+    for(std::thread &thread : threads) thread.join();
+    for(std::exception_ptr &exception : exceptions) {
+        if(exception) std::rethrow_exception(exception);
+    }
+}
+
 #endif
@@ -4,11 +4,11 @@
 #include <deque>
 #include <mutex>
 
-template<class T>
+template<class T, class ALLOCATOR = std::allocator<T>>
 class ThreadSafeQueue {
 protected:
-    std::deque<T>   buffer;
-    std::mutex      mutex;
+    std::deque<T, ALLOCATOR>    buffer;
+    std::mutex                  mutex;
 
 public:
 
@@ -43,7 +43,20 @@ public:
 
     bool empty() { return buffer.empty(); }
 
-    void clear() { buffer.clear(); }
+    size_t size() { return buffer.size(); }
+
+    // Calls f on each item, from front to back
+    template<class F>
+    void forEach(F &&f) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(T &item : buffer) f(item);
+    }
+
+    void clear() {
+        mutex.lock();
+        buffer.clear();
+        mutex.unlock();
+    }
 };
 
 #endif
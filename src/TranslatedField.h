@@ -13,8 +13,8 @@ public:
 
     const SpaceTime origin;
 
-    TranslatedField(const TranslatedField<FIELD> & field) : FIELD(field) {};
-    TranslatedField(TranslatedField<FIELD> && field) : FIELD(std::move(field)) {};
+    TranslatedField(const TranslatedField<FIELD> & field) = default;
+    TranslatedField(TranslatedField<FIELD> && field) = default;
     TranslatedField(TranslatedField<FIELD> field, SpaceTime translation) : FIELD(std::move(field)), origin(field.origin + translation) { }
     TranslatedField(SpaceTime translation) : FIELD(), origin(std::move(translation)) {}
     TranslatedField(FIELD field, SpaceTime translation) : FIELD(std::move(field)), origin(std::move(translation)) {}
@@ -31,8 +31,8 @@ public:
 
     const SpaceTime origin;
 
-    TranslatedField(const TranslatedField<FIELD> & field) : FIELD(field) {};
-    TranslatedField(TranslatedField<FIELD> && field) : FIELD(std::move(field)) {};
+    TranslatedField(const TranslatedField<FIELD> & field) = default;
+    TranslatedField(TranslatedField<FIELD> && field) = default;
     TranslatedField(TranslatedField<FIELD> field, SpaceTime translation) : FIELD(std::move(field)), origin(field.origin + translation) { }
     TranslatedField(SpaceTime translation) : FIELD(), origin(std::move(translation)) {}
     TranslatedField(FIELD field, SpaceTime translation) : FIELD(std::move(field)), origin(std::move(translation)) {}
@@ -52,8 +52,8 @@ public:
     const SpaceTime origin;
 
     TranslatedField() = default;
-    TranslatedField(const TranslatedField<FIELD> & field) : FIELD(field) {};
-    TranslatedField(TranslatedField<FIELD> && field) : FIELD(std::move(field)) {};
+    TranslatedField(const TranslatedField<FIELD> & field) = default;
+    TranslatedField(TranslatedField<FIELD> && field) = default;
     TranslatedField(TranslatedField<FIELD> field, SpaceTime translation) : FIELD(std::move(field)), origin(field.origin + translation) { }
     TranslatedField(SpaceTime translation) : FIELD(), origin(std::move(translation)) {}
     TranslatedField(FIELD field, SpaceTime translation) : FIELD(std::move(field)), origin(std::move(translation)) {}
@@ -0,0 +1,178 @@
+#ifndef TYPEDCHANNEL_H
+#define TYPEDCHANNEL_H
+
+#include <array>
+#include <bit>
+#include <concepts>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+
+#include "Concepts.h"
+#include "Channel.h"
+#include "ThreadSafeQueue.h"
+#include "Serialization.h"
+#include "predeclarations.h"
+
+// The buffer of a TypedChannel, which holds each message by value, as a variant of the message types,
+// along with the field in which it is absorbed. Executing a message is a visit on the variant,
+// so the message bodies can be inlined.
+template<class T, class... MESSAGES>
+class TypedChannelBuffer : public ChannelBuffer<typename T::Environment> {
+public:
+    typedef T::Environment                                      Environment;
+    typedef ChannelBuffer<Environment>::LambdaField             LambdaField;
+    typedef ChannelBuffer<Environment>::TranslatedLambdaField   TranslatedLambdaField;
+    typedef Environment::SpaceTime                              SpaceTime;
+
+    // Messages can be written to a checkpoint if they're plain data
+    static constexpr bool ISCHECKPOINTABLE = (std::is_trivially_copyable_v<MESSAGES> && ...);
+
+    struct Entry {
+        TranslatedLambdaField       field;
+        std::variant<MESSAGES...>   message;
+
+        template<class M>
+        Entry(TranslatedLambdaField &&field, M &&message) : field(std::move(field)), message(std::forward<M>(message)) { }
+    };
+
+    TypedChannelBuffer(CallbackChannel<Environment> &source, LambdaField field) : ChannelBuffer<Environment>(source, std::move(field)) { }
+
+    template<class M>
+    void emplace(TranslatedLambdaField &&field, M &&message) { queue.emplace(std::move(field), std::forward<M>(message)); }
+
+    bool empty() override { return queue.empty(); }
+
+    const TranslatedLambdaField &frontField() override { return queue.front().field; }
+
+    void executeFront(Agent<Environment> &agent) override {
+        T &target = static_cast<T &>(agent);
+        std::visit([&target](auto &message) { message(target); }, queue.front().message);
+    }
+
+    void pop() override { queue.pop(); }
+    void clear() override { queue.clear(); }
+
+    // Each message is written as the origin of its field, its index in MESSAGES and its bytes.
+    bool writeMessages(std::ostream &out) override {
+        if constexpr(ISCHECKPOINTABLE) {
+            writeRaw(out, static_cast<uint64_t>(queue.size()));
+            queue.forEach([&out](Entry &entry) {
+                writePosition(out, entry.field.origin);
+                writeRaw(out, static_cast<uint32_t>(entry.message.index()));
+                std::visit([&out](auto &message) { writeRaw(out, message); }, entry.message);
+            });
+            return true;
+        } else {
+            return empty();
+        }
+    }
+
+    void readMessages(std::istream &in) override {
+        if constexpr(ISCHECKPOINTABLE) {
+            uint64_t nMessages;
+            readRaw(in, nMessages);
+            for(uint64_t i = 0; i < nMessages; ++i) {
+                SpaceTime origin;
+                uint32_t index;
+                readPosition(in, origin);
+                readRaw(in, index);
+                queue.emplace(TranslatedLambdaField(origin), readMessage(in, index));
+            }
+        }
+    }
+
+protected:
+    ThreadSafeQueue<Entry, PoolAllocator<Entry>>   queue;
+
+    template<size_t I = 0>
+    static std::variant<MESSAGES...> readMessage(std::istream &in, uint32_t index) {
+        if constexpr(I < sizeof...(MESSAGES)) {
+            if(index != I) return readMessage<I+1>(in, index);
+            typedef std::variant_alternative_t<I, std::variant<MESSAGES...>> M;
+            std::array<char, sizeof(M)> bytes;
+            readRaw(in, bytes);
+            return std::variant<MESSAGES...>(std::in_place_index<I>, std::bit_cast<M>(bytes));
+        } else {
+            throw(std::runtime_error("Unknown message type in checkpoint"));
+        }
+    }
+};
+
+
+// A TypedChannel is a Channel whose messages are of a fixed set of types known at compile time,
+// rather than arbitrary lambdas. Each message type should be callable as message(T &), e.g.
+//     struct Hit { int damage; void operator()(Target &target) { target.health -= damage; } };
+//     TypedChannel<Target, Hit, Heal> channel(source, target);
+//     channel.send(Hit{3});
+// Messages are held by value in the channel's buffer, so sending doesn't allocate a std::function
+// and executing a message is a switch on its type rather than two indirect calls.
+// In other respects a TypedChannel behaves as a Channel.
+//
+// T is the type of the target, which should be derived from Agent<ENV>
+template<class T, class... MESSAGES>
+class TypedChannel {
+public:
+    typedef T::SpaceTime                        SpaceTime;
+    typedef T::Environment                      Environment;
+    typedef Environment::LambdaField            LambdaField;
+    typedef TypedChannelBuffer<T, MESSAGES...>  Buffer;
+    friend class CheckpointWriter<Environment>;
+
+    TypedChannel() : buffer(nullptr) { }
+
+    TypedChannel(const TypedChannel &) = delete;
+
+    TypedChannel(TypedChannel &&moveFrom) : buffer(moveFrom.buffer) {
+        moveFrom.buffer = nullptr;
+    }
+
+    // create a new channel between two local agents
+    TypedChannel(CallbackChannel<Environment> &source, T &target, LambdaField field = Simulation<Environment>::lambdaField) {
+        buffer = new Buffer(source, std::move(field));
+        target.attach(ChannelExecutor<Environment>(buffer));
+    }
+
+    // create a new channel to a remote target
+    TypedChannel(CallbackChannel<Environment> &source, const Channel<T> &target, LambdaField field = Simulation<Environment>::lambdaField) {
+        buffer = new Buffer(source, std::move(field));
+        target.send([reader = ChannelExecutor<Environment>(buffer)](T &obj) mutable {
+            obj.attach(std::move(reader));
+        });
+    }
+
+    ~TypedChannel() { close(); }
+
+    TypedChannel &operator=(TypedChannel &&moveFrom) {
+        if(&moveFrom != this) {
+            close();
+            buffer = moveFrom.buffer;
+            moveFrom.buffer = nullptr;
+        }
+        return *this;
+    }
+
+    // returns false if the channel has been closed at either end
+    template<class M> requires (std::same_as<std::decay_t<M>, MESSAGES> || ...)
+    bool send(M &&message) const {
+        if(!isOpen()) return false;
+        buffer->emplace(buffer->source.load()->asLambdaField(buffer->lambdaField), std::forward<M>(message));
+        return true;
+    }
+
+    // A channel is open until either its source or target closes it
+    bool isOpen() const { return buffer != nullptr && buffer->source != nullptr; }
+
+protected:
+    Buffer *buffer;
+
+    // close the source end of the channel
+    void close() {
+        if(buffer != nullptr) {
+            buffer->closeWriter();
+            buffer = nullptr;
+        }
+    }
+};
+
+#endif
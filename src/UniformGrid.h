@@ -0,0 +1,115 @@
+#ifndef UNIFORMGRID_H
+#define UNIFORMGRID_H
+
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <concepts>
+
+/// @brief A spatial index over the spatial dimensions of a MinkowskiSpace (all dimensions
+/// but the first, which is time). Space is divided into cubic cells of a given width and
+/// each item is filed under the cell that contains its position.
+///
+/// The grid doesn't store positions, so the owner should remember the position it inserted
+/// an item at in order to move or erase it.
+///
+/// @tparam SPACETIME the spacetime of the positions
+/// @tparam ITEM type used to refer to indexed items (e.g. an index into the owner's array)
+template<class SPACETIME, std::equality_comparable ITEM>
+class UniformGrid {
+public:
+    typedef SPACETIME           SpaceTime;
+    typedef SPACETIME::Time     Time;
+    static constexpr size_t     SPATIALDIMS = SPACETIME::DIMENSIONS - 1;
+    typedef std::array<int64_t,SPATIALDIMS> CellKey;
+
+    UniformGrid(Time cellWidth) : width(cellWidth) { }
+
+    void insert(const ITEM &item, const SpaceTime &position) {
+        cells[cellOf(position)].push_back(item);
+    }
+
+    void erase(const ITEM &item, const SpaceTime &position) {
+        auto cellIt = cells.find(cellOf(position));
+        if(cellIt == cells.end()) return;
+        std::vector<ITEM> &cell = cellIt->second;
+        auto it = std::find(cell.begin(), cell.end(), item);
+        if(it == cell.end()) return;
+        *it = std::move(cell.back());
+        cell.pop_back();
+        if(cell.empty()) cells.erase(cellIt);
+    }
+
+    void move(const ITEM &item, const SpaceTime &from, const SpaceTime &to) {
+        if(cellOf(from) == cellOf(to)) return;
+        erase(item, from);
+        insert(item, to);
+    }
+
+    // Calls f(item) on every item in a cell that overlaps the ball of the given radius about
+    // the spatial part of centre. This is a superset of the items within the ball, so the
+    // caller should do its own exact test.
+    template<class F>
+    void forEachNear(const SpaceTime &centre, Time radius, F &&f) const {
+        CellKey lo = cellOf(centre, -radius);
+        CellKey hi = cellOf(centre, radius);
+        double nCellsInBox = 1.0;
+        for(size_t d=0; d<SPATIALDIMS; ++d) nCellsInBox *= static_cast<double>(hi[d] - lo[d] + 1);
+        if(nCellsInBox > cells.size()) { // cheaper to look at all occupied cells
+            for(const auto &[key, cell] : cells) {
+                bool inBox = true;
+                for(size_t d=0; d<SPATIALDIMS; ++d) inBox = inBox && key[d] >= lo[d] && key[d] <= hi[d];
+                if(inBox) for(const ITEM &item : cell) f(item);
+            }
+        } else {
+            CellKey key = lo;
+            while(true) {
+                auto cellIt = cells.find(key);
+                if(cellIt != cells.end()) for(const ITEM &item : cellIt->second) f(item);
+                size_t d = 0;
+                while(d < SPATIALDIMS && key[d] == hi[d]) { key[d] = lo[d]; ++d; }
+                if(d == SPATIALDIMS) break;
+                ++key[d];
+            }
+        }
+    }
+
+    size_t nOccupiedCells() const { return cells.size(); }
+
+    void clear() { cells.clear(); }
+
+    // The cell containing the spatial part of position, with every coordinate shifted by displacement
+    CellKey cellOf(const SpaceTime &position, Time displacement = 0) const {
+        return cellOf(position, displacement, std::make_index_sequence<SPATIALDIMS>());
+    }
+
+protected:
+    struct CellHash {
+        size_t operator ()(const CellKey &key) const {
+            size_t h = 0;
+            for(int64_t k : key) h = h*1000003 ^ std::hash<int64_t>()(k);
+            return h;
+        }
+    };
+
+    Time                                            width;
+    std::unordered_map<CellKey,std::vector<ITEM>,CellHash> cells;
+
+    template<size_t... INDICES>
+    CellKey cellOf(const SpaceTime &position, Time displacement, std::index_sequence<INDICES...>) const {
+        return CellKey{ coordinateToCell(std::get<INDICES+1>(position) + displacement)... };
+    }
+
+    int64_t coordinateToCell(Time x) const {
+        if constexpr(std::integral<Time>) {
+            return x >= 0 ? x/width : -((width - 1 - x)/width);
+        } else {
+            return static_cast<int64_t>(std::floor(x/width));
+        }
+    }
+};
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef VELOCITY_H
 #define VELOCITY_H
 
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
 #include "Concepts.h"
 
 // An inner product space defines a subset of velocities {V : V.V=1} 
@@ -41,6 +45,17 @@ class Velocity : public SPACETIME {
 public:
     Velocity() : SPACETIME(1) { }
 
+    // Construct from a vector of unit length in the future direction.
+    // In an integer spacetime these are the lattice velocities, e.g. (3,2,2) in
+    // 2+1 dimensions, and the check is exact.
+    explicit Velocity(const SPACETIME &velocity) : SPACETIME(velocity) {
+        if constexpr(std::integral<typename SPACETIME::Time>) {
+            if(velocity*velocity != 1 || velocity.labTime() <= 0) throw(std::runtime_error("A lattice velocity must be future pointing with unit length"));
+        } else {
+            assert(std::fabs(velocity*velocity - 1) < 1e-8 && velocity.labTime() > 0);
+        }
+    }
+
     // We can map all points in spacetime onto the velocity manifold by projecting
     // along lab-energy (lab-time) until we reach unit inner product. If time is
     // integer, there may be more than one value that along this projection that has
@@ -36,4 +36,29 @@ T delta(const T &f) {
     return 1;
 }
 
+// Integer square root: the largest r such that r*r <= n (n should be non-negative).
+// The floating point estimate is corrected so the result is exact for all 64-bit values.
+template<std::integral T>
+T isqrt(T n) {
+    T r = static_cast<T>(std::sqrt(static_cast<double>(n)));
+    while(r > 0 && r > n/r) --r;
+    while(r+1 <= n/(r+1)) ++r;
+    return r;
+}
+
+// The smallest r such that r*r >= n (n should be non-negative).
+template<std::integral T>
+T isqrtCeil(T n) {
+    T r = isqrt(n);
+    return (r*r == n) ? r : r+1;
+}
+
+// Integer division that rounds towards positive infinity.
+template<std::integral T>
+T ceilDiv(T numerator, T denominator) {
+    T q = numerator/denominator;
+    if(numerator%denominator != 0 && ((numerator < 0) == (denominator < 0))) ++q;
+    return q;
+}
+
 #endif
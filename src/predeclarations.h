@@ -2,9 +2,15 @@
 
 template<Environment ENV> class Simulation;
 template<Environment ENV> class Agent;
+template<Environment ENV> class AgentGroup;
 template<Environment ENV> class SourceAgent;
 template<Environment ENV> class CallbackChannel;
+template<Environment ENV> class CallbackField;
+template<Environment ENV> class RemoteChannelBuffer;
+template<Environment ENV> class Checkpoint;
+template<Environment ENV> class CheckpointWriter;
 template<class T> class Channel;
 template<class T> class RemoteReference;
+template<class T> class FanIn;
 
 
@@ -0,0 +1,74 @@
+// Checks that a member of an AgentGroup that is blocked on another member, or on an agent outside
+// the group, is released when the other agent is deleted without moving on.
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "AgentGroup.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+// kept outside the receivers, which are deleted once released
+bool receiverDeleted = false;
+bool outsiderReceiverDeleted = false;
+
+// Once released, finds its only channel closed, so is deleted.
+class Receiver : public Agent<Env> {
+public:
+    bool *deleted;
+
+    Receiver(bool &deleted) : deleted(&deleted) { }
+    ~Receiver() { *deleted = true; }
+};
+
+class Sender : public Agent<Env> {
+public:
+    Channel<Receiver> out;
+};
+
+class Killer : public Agent<Env> {
+public:
+    Channel<Sender> out;
+};
+
+int main() {
+    AgentGroup<Env> *group = new AgentGroup<Env>();
+    Receiver &receiver = group->add<Receiver>(receiverDeleted); // run first, so it blocks on the sender before the sender is deleted
+    Sender &sender = group->add<Sender>();
+    receiver.jumpTo({1.5, 0.0});
+    sender.jumpTo({1.5, 0.0});
+    sender.out = Channel<Receiver>(sender, receiver);
+
+    // kills the sender at its starting position, so it's deleted without moving
+    Killer *killer = new Killer();
+    killer->jumpTo({0.5, 0.0});
+    killer->out = Channel<Sender>(*killer, sender);
+    Simulation<Env>::currentThreadAgent = killer;
+    killer->out.send([](Sender &sender) { sender.die(); });
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    // a member blocked on an agent outside the group, which is killed at its starting position
+    AgentGroup<Env> *outsiderGroup = new AgentGroup<Env>();
+    Receiver &outsiderReceiver = outsiderGroup->add<Receiver>(outsiderReceiverDeleted);
+    outsiderReceiver.jumpTo({1.5, 4.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Sender *outsider = new Sender();
+    outsider->jumpTo({1.5, 4.0});
+    outsider->out = Channel<Receiver>(*outsider, outsiderReceiver);
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Killer *outsiderKiller = new Killer();
+    outsiderKiller->jumpTo({0.5, 4.0});
+    outsiderKiller->out = Channel<Sender>(*outsiderKiller, *outsider);
+    Simulation<Env>::currentThreadAgent = outsiderKiller;
+    outsiderKiller->out.send([](Sender &sender) { sender.die(); });
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::start();
+    CHECK(receiverDeleted);
+    CHECK(outsiderReceiverDeleted);
+    return testResult();
+}
@@ -0,0 +1,79 @@
+// Checks that an AgentPopulation steps its members in batches at the lab times they ask for,
+// with their positions moved along their trajectories to that time, and that with integer
+// time a member moves to the first point on its trajectory at or after the time.
+
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "AgentPopulation.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+constexpr size_t NMEMBERS = 10;
+
+int     nBatches = 0;
+int     nSteps[NMEMBERS];
+bool    positionsCorrect = true;
+
+class Walkers : public AgentPopulation<Walkers, Env, double> {
+public:
+    // members step every `column<0>()` of lab time
+    void stepMembers(std::span<const size_t> readyMembers) {
+        ++nBatches;
+        for(size_t member : readyMembers) {
+            ++nSteps[member];
+            double labTime = position().labTime();
+            if(std::abs(positions[member].labTime() - labTime) > 1e-9) positionsCorrect = false;
+            if(std::abs(std::get<1>(positions[member]) - 0.5*(labTime - 1.0)) > 1e-9) positionsCorrect = false;
+            if(labTime + column<0>()[member] < 20.0) wakeAt(member, labTime + column<0>()[member]);
+        }
+    }
+};
+
+typedef MinkowskiSpace<int,int,int> IM;
+typedef ForwardSimulation<IM, InnerProdField<IM,1>, LabTimeBoundary<IM,20>, ThreadPool<1>> IntEnv;
+
+class IntWalkers : public AgentPopulation<IntWalkers, IntEnv> {
+public:
+    void stepMembers(std::span<const size_t>) { }
+};
+
+// An integer population isn't run, only advanced.
+void testIntegerAdvance() {
+    IntWalkers *walkers = new IntWalkers();
+    size_t member = walkers->addMember(IM(0,0,0), Velocity<IM>(IM(3,2,2)));
+    size_t members[] = {member};
+    walkers->advanceMembers(members, 5);
+    CHECK(walkers->positions[member] == IM(6,4,4));
+    walkers->advanceMembers(members, 6);
+    CHECK(walkers->positions[member] == IM(6,4,4));
+}
+
+int main() {
+    testIntegerAdvance();
+
+    Walkers *walkers = new Walkers();
+    walkers->jumpTo({0.5, 0.0});
+    double gamma = 1.0/sqrt(1.0 - 0.25);
+    for(size_t i=0; i<NMEMBERS; ++i) {
+        size_t member = walkers->addMember(M(1.0, 0.0), Velocity<M>(M(double(gamma), 0.5*gamma)), 1.0 + (i % 3));
+        walkers->wakeAt(member, 2.0);
+    }
+    Simulation<Env>::start();
+
+    CHECK(positionsCorrect);
+    for(size_t i=0; i<NMEMBERS; ++i) {
+        double period = 1.0 + (i % 3);
+        CHECK(nSteps[i] == 1 + int((19.999 - 2.0)/period));
+    }
+    // batches at 2..19 only, as members with different periods share times
+    CHECK(nBatches == 18);
+    std::cout << nBatches << " batches" << std::endl;
+    return testResult();
+}
@@ -0,0 +1,67 @@
+// Checks that a broadcast within a radius is only sent to the members that could absorb it inside
+// the region, and executed by exactly those that do, and that a broadcast to a REGION is sent to
+// every member and executed by those that absorb it inside the region.
+
+#include <cmath>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "BroadcastChannel.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,30.0>, ThreadPool<2>> Env;
+
+constexpr int NMEMBERS = 20;
+constexpr double RADIUS = 2.5;
+
+int nRadiusExecuted[NMEMBERS];  // kept outside the members, which are deleted once their channels close
+int nRegionExecuted[NMEMBERS];
+
+class Member : public Agent<Env> {
+public:
+    int id;
+
+    Member(int id) : id(id) { }
+};
+
+class Source : public Agent<Env> {
+public:
+    BroadcastChannel<Member> members = BroadcastChannel<Member>(*this, 1.0);
+};
+
+int main() {
+    Source *source = new Source();
+    source->jumpTo({0.5, 0.0, 0.0});
+    for(int i = 0; i < NMEMBERS; ++i) {
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        Member *member = new Member(i);
+        member->jumpTo({0.5, double(i), 0.0});   // i from the source along x
+        source->members.addMember(*member);
+    }
+    CHECK(source->members.size() == NMEMBERS);
+
+    Simulation<Env>::currentThreadAgent = source;
+    size_t nSent = source->members.broadcast(RADIUS, [](const Member &member) { ++nRadiusExecuted[member.id]; });
+    size_t nSentToRegion = source->members.broadcast(SpatialBall<M>(M(0.5, 10.0, 0.0), 1.5),
+        [](const Member &member) { ++nRegionExecuted[member.id]; });
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    // A stationary member at distance d absorbs the broadcast at lab time 0.5 + sqrt(1 + d^2), so
+    // the latest absorption in the region is at 0.5 + sqrt(1 + RADIUS^2), and a member seen at
+    // lab time 0.5 can only reach the region in time from within RADIUS + sqrt(1 + RADIUS^2).
+    double reach = RADIUS + sqrt(1.0 + RADIUS*RADIUS);
+    CHECK(nSent == size_t(floor(reach)) + 1);
+    CHECK(nSent < NMEMBERS);
+    CHECK(nSentToRegion == NMEMBERS);
+
+    Simulation<Env>::start();
+    for(int i = 0; i < NMEMBERS; ++i) {
+        CHECK(nRadiusExecuted[i] == (i <= RADIUS ? 1 : 0));
+        CHECK(nRegionExecuted[i] == (std::abs(i - 10) <= 1 ? 1 : 0));
+    }
+    return testResult();
+}
@@ -0,0 +1,135 @@
+// Checks that BulkConstruction makes enough agents and channels to be split over threads, handing the agents
+// to the main thread in order of index and attaching every channel, that lambdas are carried by the channels,
+// and that when making an agent throws, every agent made so far is deleted and none are handed over.
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "BulkConstruction.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,5.0>, ThreadPool<2>> Env;
+typedef BulkConstruction<Env> Bulk;
+
+constexpr size_t NNODES = 4 * Bulk::MINPERTHREAD + 7;
+constexpr size_t BADNODE = 2 * Bulk::MINPERTHREAD + 3;  // in a slice after the first
+
+size_t failingId = NNODES;    // id of a node whose constructor throws, if any
+std::atomic<size_t> nNodesMade = 0;
+std::atomic<size_t> nNodesDeleted = 0;
+std::atomic<size_t> nReceived = 0;
+
+class Node : public Agent<Env> {
+public:
+    size_t                          id;
+    std::vector<Channel<Node>>      out;
+
+    Node(size_t id) : id(id) {
+        if(id == failingId) throw(std::runtime_error("Node constructor failed"));
+        ++nNodesMade;
+    }
+
+    ~Node() { ++nNodesDeleted; }
+
+    void sendAll() {
+        for(Channel<Node> &channel : out) channel.send([](Node &) { ++nReceived; });
+    }
+};
+
+Node *makeNode(size_t i) {
+    Node *node = new Node(i);
+    node->jumpTo({0.5, 0.0});
+    return node;
+}
+
+// the agents on the main thread's callback queue, which are put back
+std::vector<Agent<Env> *> mainThreadAgents() {
+    CallbackQueue<Env>::AgentDeque agents = Simulation<Env>::mainThread.getCallbackField()->takeAll();
+    std::vector<Agent<Env> *> copy(agents.begin(), agents.end());
+    Simulation<Env>::mainThread.getCallbackField()->pushAll(std::move(agents));
+    return copy;
+}
+
+// makeAgents where make() throws, or where an agent's constructor throws
+void testFailedMake() {
+    size_t nQueued = mainThreadAgents().size();
+    bool hasThrown = false;
+    try {
+        Bulk::makeAgents<Node>(NNODES, [](size_t i) {
+            if(i == BADNODE) throw(std::runtime_error("make failed"));
+            return makeNode(i);
+        });
+    } catch(const std::runtime_error &) {
+        hasThrown = true;
+    }
+    CHECK(hasThrown);
+    CHECK(nNodesMade >= BADNODE);
+    CHECK(nNodesDeleted == nNodesMade);
+    CHECK(mainThreadAgents().size() == nQueued);
+
+    hasThrown = false;
+    nNodesMade = nNodesDeleted = 0;
+    failingId = BADNODE;
+    try {
+        Bulk::makeAgents<Node>(NNODES, makeNode);
+    } catch(const std::runtime_error &) {
+        hasThrown = true;
+    }
+    failingId = NNODES;
+    CHECK(hasThrown);
+    CHECK(nNodesMade >= BADNODE);
+    CHECK(nNodesDeleted == nNodesMade);
+    CHECK(mainThreadAgents().size() == nQueued);
+}
+
+int main() {
+    testFailedMake();
+
+    std::vector<Node *> nodes = Bulk::makeAgents<Node>(NNODES, makeNode);
+    CHECK(nodes.size() == NNODES);
+    bool isInOrder = true;
+    for(size_t i = 0; i < nodes.size(); ++i) if(nodes[i]->id != i) isInOrder = false;
+    std::vector<Agent<Env> *> queued = mainThreadAgents();
+    CHECK(queued.size() >= NNODES);
+    for(size_t i = 0; i < NNODES && i < queued.size(); ++i) {
+        if(queued[queued.size() - NNODES + i] != nodes[i]) isInOrder = false;
+    }
+    CHECK(isInOrder);
+
+    // a ring, and a chord from each node
+    std::vector<Bulk::Edge> edges;
+    std::vector<size_t> inDegree(NNODES, 0);
+    for(size_t i = 0; i < NNODES; ++i) {
+        edges.emplace_back(i, (i + 1) % NNODES);
+        edges.emplace_back(i, (7 * i + 3) % NNODES);
+    }
+    for(const Bulk::Edge &edge : edges) ++inDegree[edge.second];
+    std::vector<Channel<Node>> channels = Bulk::makeChannels(nodes, nodes, edges);
+    CHECK(channels.size() == edges.size());
+    bool areAttached = true;
+    for(Channel<Node> &channel : channels) if(!channel.isOpen()) areAttached = false;
+    for(size_t i = 0; i < NNODES; ++i) if(nodes[i]->nChannels() != inDegree[i]) areAttached = false;
+    CHECK(areAttached);
+
+    bool hasThrown = false;
+    try {
+        Bulk::makeChannels(nodes, nodes, std::vector<Bulk::Edge>{{0, NNODES}});
+    } catch(const std::runtime_error &) {
+        hasThrown = true;
+    }
+    CHECK(hasThrown);
+
+    for(size_t e = 0; e < edges.size(); ++e) nodes[edges[e].first]->out.push_back(std::move(channels[e]));
+    for(Node *node : nodes) node->callAt(1.0, [node]() { node->sendAll(); });
+
+    Simulation<Env>::start();
+    CHECK(nReceived == edges.size());
+    return testResult();
+}
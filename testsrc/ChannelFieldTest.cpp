@@ -0,0 +1,65 @@
+// Checks that channels to the same target can have lambda fields with different shifts: a lambda
+// sent on each is absorbed where (X-P-R).(X-P-R) = 1 for the point of emission P and that channel's
+// shift R, so the lambdas are executed in the order of their absorption rather than the order they were sent.
+
+#include <cmath>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "ShiftedField.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ShiftedField<InnerProdField<M,1.0>> ReactionField;
+typedef ForwardSimulation<M, ReactionField, LabTimeBoundary<M,10.0>, ThreadPool<2>> Env;
+
+struct Delivery {
+    int     channel;
+    double  labTime;
+};
+
+std::vector<Delivery> deliveries; // kept outside the receiver, which is deleted once its channels close
+
+class Receiver : public Agent<Env> {
+public:
+    void receive(int channel) { deliveries.push_back({channel, position().labTime()}); }
+};
+
+class Sender : public Agent<Env> {
+public:
+    Channel<Receiver> quick;
+    Channel<Receiver> slow;
+};
+
+int main() {
+    Receiver *receiver = new Receiver();
+    receiver->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Sender *sender = new Sender();
+    sender->jumpTo({0.5, 0.0});
+    sender->slow = Channel<Receiver>(*sender, *receiver, ReactionField(M(3.0, 0.0)));
+    sender->quick = Channel<Receiver>(*sender, *receiver, ReactionField(M(1.0, 0.0)));
+    Simulation<Env>::currentThreadAgent = sender;
+    sender->slow.send([](Receiver &receiver) { receiver.receive(1); });
+    sender->quick.send([](Receiver &receiver) { receiver.receive(0); });
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    // the quick channel's lambda is 2 after the receiver's position, and doesn't wait on the sender
+    std::shared_ptr<CallbackField<Env>> blockingQueue;
+    CHECK(std::fabs(receiver->getInChannel(1).timeToNext(*receiver, blockingQueue) - 2.0) < 1e-9); // quick lambda at 2.5
+    CHECK(blockingQueue == nullptr);
+
+    Simulation<Env>::start();
+    CHECK(deliveries.size() == 2);
+    if(deliveries.size() == 2) {
+        CHECK(deliveries[0].channel == 0);
+        CHECK(std::fabs(deliveries[0].labTime - 2.5) < 1e-9);
+        CHECK(deliveries[1].channel == 1);
+        CHECK(std::fabs(deliveries[1].labTime - 4.5) < 1e-9);
+    }
+    return testResult();
+}
@@ -0,0 +1,171 @@
+// Checks that a simulation paused with runUntil(), saved to a checkpoint and restored in a new
+// process runs on to the same state as the original simulation, including the messages that
+// were in flight and the timers at the checkpoint. Also checks that save() refuses agents with
+// timers that they don't set again on restore, and AgentGroups with members.
+//
+// Run with no arguments. The restored simulation is run by this program with the arguments
+//     restore <checkpoint file>
+
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "AgentGroup.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "TypedChannel.h"
+#include "Checkpoint.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,5.0>, ThreadPool<2>> Env;
+
+constexpr double CHECKPOINTTIME = 5.5;
+constexpr double ENDTIME = 10.5;
+
+class Counter;
+class Ticker;
+Counter *theCounter = nullptr;
+Ticker *theTicker = nullptr;
+
+class Counter : public Agent<Env> {
+public:
+    long total = 0;
+
+    Counter() { theCounter = this; }
+    Counter(CheckpointReader<Env> &in) {
+        in.read(total);
+        theCounter = this;
+    }
+
+    void save(CheckpointWriter<Env> &out) const { out.write(total); }
+};
+
+struct Add {
+    long x;
+    void operator()(Counter &counter) const { counter.total += x; }
+};
+
+struct Double {
+    void operator()(Counter &counter) const { counter.total *= 2; }
+};
+
+// Sends to the counter on a timer. Messages are absorbed one unit of time after they're sent,
+// so there is always one in flight at the checkpoint.
+class Ticker : public Agent<Env> {
+public:
+    TypedChannel<Counter, Add, Double>  out;
+    int                                 nTicks = 0;
+    double                              nextTick = 1.0;
+
+    Ticker() { theTicker = this; }
+    Ticker(CheckpointReader<Env> &in) {
+        in.read(nTicks);
+        in.read(nextTick);
+        in.read(out);
+        callAt(nextTick, [this]() { tick(); });
+        theTicker = this;
+    }
+
+    void save(CheckpointWriter<Env> &out) const {
+        out.write(nTicks);
+        out.write(nextTick);
+        out.write(this->out);
+        out.setsTimersOnRestore();
+    }
+
+    void tick() {
+        ++nTicks;
+        if(nTicks % 3 == 0) out.send(Double()); else out.send(Add{nTicks});
+        nextTick = position().labTime() + 1.0;
+        callAt(nextTick, [this]() { tick(); });
+    }
+};
+
+// An agent whose timers aren't restored
+class Forgetful : public Agent<Env> {
+public:
+    Forgetful() { }
+    Forgetful(CheckpointReader<Env> &) { }
+    void save(CheckpointWriter<Env> &) const { }
+};
+
+Checkpoint<Env> makeCheckpoint() {
+    Checkpoint<Env> checkpoint;
+    checkpoint.registerType<Counter>("Counter");
+    checkpoint.registerType<Ticker>("Ticker");
+    checkpoint.registerType<Forgetful>("Forgetful");
+    return checkpoint;
+}
+
+bool throwsOnSave(Checkpoint<Env> &checkpoint, const std::string &fileName) {
+    try {
+        checkpoint.save(fileName);
+    } catch(const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+// Continues from the checkpoint and prints the final state, then checks that an agent with
+// a timer it doesn't restore can't be checkpointed.
+int restore(const std::string &fileName) {
+    Checkpoint<Env> checkpoint = makeCheckpoint();
+    checkpoint.restore(fileName);
+    Simulation<Env>::runUntil(ENDTIME);
+    std::cout << theCounter->total << " " << theTicker->nTicks << std::endl;
+
+    Forgetful *forgetful = new Forgetful();
+    forgetful->jumpTo({ENDTIME + 1.0, 0.0});
+    forgetful->callAt(ENDTIME + 2.0, []() { });
+    CHECK(throwsOnSave(checkpoint, fileName + ".forgetful"));
+    std::filesystem::remove(fileName + ".forgetful");
+    return testResult();
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 3 && std::string(argv[1]) == "restore") return restore(argv[2]);
+
+    std::string fileName = (std::filesystem::temp_directory_path() / "CheckpointTest.checkpoint").string();
+    Checkpoint<Env> checkpoint = makeCheckpoint();
+    Counter *counter = new Counter();
+    counter->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Ticker *ticker = new Ticker();
+    ticker->jumpTo({0.5, 0.0});
+    ticker->out = TypedChannel<Counter, Add, Double>(*ticker, *counter);
+    ticker->callAt(1.0, [ticker]() { ticker->tick(); });
+
+    Simulation<Env>::runUntil(CHECKPOINTTIME);
+    checkpoint.save(fileName);
+    Simulation<Env>::runUntil(ENDTIME);
+    long total = theCounter->total;
+    int nTicks = theTicker->nTicks;
+    CHECK(nTicks == 10);
+
+    long restoredTotal = -1;
+    int restoredTicks = -1;
+    FILE *restored = popen((std::string(argv[0]) + " restore " + fileName).c_str(), "r");
+    CHECK(restored != nullptr);
+    if(restored != nullptr) {
+        CHECK(fscanf(restored, "%ld %d", &restoredTotal, &restoredTicks) == 2);
+        CHECK(pclose(restored) == 0);
+    }
+    std::filesystem::remove(fileName);
+    std::cout << "total " << total << " after " << nTicks << " ticks, restored " << restoredTotal << " after " << restoredTicks << std::endl;
+    CHECK(restoredTotal == total);
+    CHECK(restoredTicks == nTicks);
+
+    AgentGroup<Env> *group = new AgentGroup<Env>();
+    group->jumpTo({ENDTIME + 1.0, 0.0});
+    Simulation<Env>::currentThreadAgent = group;
+    group->add<Counter>();
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    CHECK(throwsOnSave(checkpoint, fileName));
+    std::filesystem::remove(fileName);
+    return testResult();
+}
@@ -0,0 +1,164 @@
+// Checks that an agent's coroutines are resumed by values put into a Mailbox and by reaching a lab time
+// (reachLabTime), that their frames come from, and are returned to, the agent's pool, that a coroutine
+// still suspended is destroyed along with its agent, and that a coroutine that isn't a member of an
+// agent runs from the heap.
+
+#include <cmath>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "Coroutine.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+constexpr int NVALUES = 5;
+constexpr double WAKETIME = 3.0;
+
+// kept outside the agents, which are deleted once their channels close
+int sum = 0;
+int nGuardsDestroyed = 0;
+double wokeAt = -1.0;
+bool readyWithoutWaiting = false;
+std::vector<int> received;
+std::vector<double> receivedAt;
+bool sleeperFinished = false;
+
+struct Guard {
+    ~Guard() { ++nGuardsDestroyed; }
+};
+
+class Worker : public Agent<Env>, public CoroutineFrames {
+public:
+    Mailbox<int> inbox;
+
+    AgentTask sumThree() {
+        int total = co_await inbox;
+        total += co_await inbox;
+        total += co_await inbox;
+        sum = total;
+    }
+
+    AgentTask waitForever() {
+        Guard guard;
+        co_await inbox;
+        co_await inbox;
+    }
+
+    size_t nFreeFrames() const {
+        size_t n = 0;
+        for(const FreeList &list : freeLists) n += list.blocks.size();
+        return n;
+    }
+};
+
+class Sleeper : public Agent<Env>, public CoroutineFrames {
+public:
+    Mailbox<int> inbox;
+
+    AgentTask run() {
+        co_await reachLabTime(*this, WAKETIME);
+        wokeAt = position().labTime();
+        auto alreadyPassed = reachLabTime(*this, 1.0);
+        readyWithoutWaiting = alreadyPassed.await_ready();
+        co_await alreadyPassed;
+        while(received.size() < NVALUES) {
+            received.push_back(co_await inbox);
+            receivedAt.push_back(position().labTime());
+        }
+        sleeperFinished = true;
+        die();
+    }
+};
+
+class Sender : public Agent<Env> {
+public:
+    Channel<Sleeper> out;
+    int nSent = 0;
+
+    void tick() {
+        out.send([value = nSent](Sleeper &sleeper) { sleeper.inbox.put(value); });
+        if(++nSent < NVALUES) callAt(position().labTime() + 1.0, [this]() { tick(); });
+    }
+};
+
+// not a member of an agent, so its frame comes from the heap
+AgentTask copyOne(Mailbox<int> &from, int &to) {
+    to = co_await from;
+}
+
+// Drives a worker's coroutines by hand
+void testWorker() {
+    Worker *worker = new Worker();
+    worker->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = worker;
+
+    worker->sumThree();
+    CHECK(worker->nTasks() == 1);
+    worker->inbox.put(1);
+    worker->inbox.put(2);
+    CHECK(worker->nTasks() == 1);
+    worker->inbox.put(3);
+    CHECK(worker->nTasks() == 0);
+    CHECK(sum == 6);
+    CHECK(worker->nFreeFrames() == 1);
+
+    worker->inbox.put(10);           // waiting in the mailbox before the coroutine starts
+    worker->sumThree();              // reuses the frame of the first
+    CHECK(worker->nFreeFrames() == 0);
+    worker->inbox.put(20);
+    worker->inbox.put(30);
+    CHECK(sum == 60);
+    CHECK(worker->nFreeFrames() == 1);
+
+    worker->waitForever();
+    worker->inbox.put(1);
+    CHECK(worker->nTasks() == 1);
+    CHECK(nGuardsDestroyed == 0);
+    Simulation<Env>::mainThread.pCallbackBuffer->remove(worker); // as it's stepped here instead
+    worker->die();
+    worker->step();                  // deletes the worker, and its suspended coroutine
+    CHECK(nGuardsDestroyed == 1);
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Mailbox<int> mailbox;
+    int copied = 0;
+    copyOne(mailbox, copied);
+    CHECK(copied == 0);
+    mailbox.put(7);
+    CHECK(copied == 7);
+    CHECK(mailbox.empty());
+}
+
+int main() {
+    testWorker();
+
+    Sleeper *sleeper = new Sleeper();
+    sleeper->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Sender *sender = new Sender();
+    sender->jumpTo({0.5, 0.0});
+    sender->out = Channel<Sleeper>(*sender, *sleeper);
+    sender->callAt(1.0, [sender]() { sender->tick(); });
+    Simulation<Env>::currentThreadAgent = sleeper;
+    sleeper->run();
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::start();
+    CHECK(std::fabs(wokeAt - WAKETIME) < 1e-9);
+    CHECK(readyWithoutWaiting);
+    CHECK(sleeperFinished);
+    CHECK(received.size() == NVALUES);
+    for(size_t i = 0; i < received.size(); ++i) {
+        CHECK(received[i] == int(i));
+        CHECK(receivedAt[i] >= WAKETIME);
+        // a value sent at lab time 1+i is absorbed a lab time of 1 later, unless the sleeper was still asleep
+        if(2.0 + i > WAKETIME) CHECK(std::fabs(receivedAt[i] - (2.0 + i)) < 1e-9);
+    }
+    return testResult();
+}
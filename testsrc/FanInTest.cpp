@@ -0,0 +1,86 @@
+// Checks that a FanIn delivers the lambdas from many sources in lab-time order and that,
+// as for separate channels, a lambda is executed before the target blocks on a source
+// whose next event is at the same time.
+
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "FanIn.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+class Hub : public Agent<Env> {
+public:
+    FanIn<Hub>  inbox = FanIn<Hub>(*this);
+    int         nReceived = 0;
+    double      lastLabTime = -1e9;
+    bool        ordered = true;
+
+    void receive() {
+        ++nReceived;
+        if(position().labTime() < lastLabTime) ordered = false;
+        lastLabTime = position().labTime();
+    }
+};
+
+class Source : public Agent<Env> {
+public:
+    Channel<Hub>    out;
+    int             id = 0;
+
+    bool hasThreadSafeDestructor() const override { return true; } // closing a channel is thread safe
+
+    void tick() {
+        out.send([](Hub &hub) { hub.receive(); });
+        callAt(position().labTime() + 0.7 + 0.01*id, [this]() { tick(); });
+    }
+};
+
+// A source that's ready at the same time as one the hub would block on
+void testLambdaBeforeBlocking() {
+    Hub *hub = new Hub();
+    hub->jumpTo({1.0, 0.0});
+    Source *idle = new Source();
+    idle->jumpTo({0.0, 0.0});
+    Source *sender = new Source();
+    sender->jumpTo({0.0, 0.0});
+    idle->out = hub->inbox.connect(*idle);     // connected first, so it is at the top of the heap on a tie
+    sender->out = hub->inbox.connect(*sender);
+    Simulation<Env>::currentThreadAgent = sender;
+    sender->out.send([](Hub &hub) { hub.receive(); });
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    std::shared_ptr<CallbackField<Env>> blockingQueue;
+    double time = hub->getInChannel(0).timeToNext(*hub, blockingQueue);
+    CHECK(time == 0.0);
+    CHECK(blockingQueue == nullptr);
+    hub->die();
+    idle->die();
+    sender->die();
+}
+
+int main() {
+    testLambdaBeforeBlocking();
+
+    Hub *hub = new Hub();
+    hub->jumpTo({0.1, 0.0});
+    for(int i=0; i<100; ++i) {
+        Source *source = new Source();
+        source->id = i;
+        source->jumpTo({0.5, (i-50)*0.1});
+        source->out = hub->inbox.connect(*source);
+        source->callAt(1.0, [source]() { source->tick(); });
+    }
+    Simulation<Env>::start();
+    CHECK(hub->ordered);
+    CHECK(hub->nReceived > 0);
+    CHECK(hub->inbox.nSources() == 100); // the sources still have timers, so are kept to the end
+    std::cout << hub->nReceived << " lambdas received" << std::endl;
+    return testResult();
+}
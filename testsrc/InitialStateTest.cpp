@@ -0,0 +1,235 @@
+// Checks that an InitialState file written with write() reads back the same positions, velocities, states and
+// edges, that the agents and channels made from it are in the right places and carry lambdas, and that enough
+// agents are loaded for the work to be split over threads. Also checks that files that aren't initial states
+// for this spacetime and state are rejected, that agents outside their creator's future light-cone are found
+// before any agent is made, and that when making an agent throws, every agent made so far is deleted.
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "InitialState.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,10.0>, ThreadPool<2>> Env;
+
+struct NodeState {
+    uint64_t    id;
+    double      weight;
+};
+
+struct WideState {
+    uint64_t    id;
+    double      weight;
+    double      extra;
+};
+
+typedef InitialState<Env, NodeState> Initial;
+typedef BulkConstruction<Env> Bulk;
+
+constexpr size_t NNODES = 4 * Bulk::MINPERTHREAD + 5;
+constexpr size_t BADNODE = 2 * Bulk::MINPERTHREAD + 3;  // in a slice after the first
+
+const Velocity<M> VELOCITY(M(1.25, 0.75));
+
+size_t failingId = NNODES;    // id of a node whose constructor throws, if any
+std::atomic<size_t> nNodesMade = 0;
+std::atomic<size_t> nNodesDeleted = 0;
+std::atomic<size_t> nReceived = 0;
+
+class Node : public Agent<Env> {
+public:
+    NodeState                       state;
+    std::vector<Channel<Node>>      out;
+
+    Node(const NodeState &state) : state(state) {
+        if(state.id == failingId) throw(std::runtime_error("Node constructor failed"));
+        ++nNodesMade;
+    }
+
+    ~Node() { ++nNodesDeleted; }
+
+    void sendAll() {
+        for(Channel<Node> &channel : out) channel.send([](Node &) { ++nReceived; });
+    }
+};
+
+// An agent from whose position others are made
+class Creator : public Agent<Env> { };
+
+std::string tempFile(const std::string &name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+bool isRejected(const std::string &fileName) {
+    try {
+        Initial initialState(fileName);
+    } catch(const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+// the number of agents on the main thread's callback queue
+size_t nQueued() {
+    CallbackQueue<Env>::AgentDeque agents = Simulation<Env>::mainThread.getCallbackField()->takeAll();
+    size_t n = agents.size();
+    Simulation<Env>::mainThread.getCallbackField()->pushAll(std::move(agents));
+    return n;
+}
+
+void testBadFiles(const std::string &goodFile) {
+    CHECK(isRejected(tempFile("InitialStateTest.missing")));
+    CHECK(!isRejected(goodFile));
+
+    bool isRejectedForState = false;
+    try {
+        InitialState<Env, WideState> initialState(goodFile);
+    } catch(const std::runtime_error &) {
+        isRejectedForState = true;
+    }
+    CHECK(isRejectedForState);
+
+    std::string badFile = tempFile("InitialStateTest.bad");
+    std::filesystem::copy_file(goodFile, badFile, std::filesystem::copy_options::overwrite_existing);
+    {
+        std::fstream file(badFile, std::ios::binary | std::ios::in | std::ios::out);
+        file.put('X');
+    }
+    CHECK(isRejected(badFile));     // wrong magic number
+
+    std::filesystem::copy_file(goodFile, badFile, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::resize_file(badFile, std::filesystem::file_size(goodFile) - 1);
+    CHECK(isRejected(badFile));     // truncated
+
+    std::filesystem::resize_file(badFile, sizeof(Initial::Header) - 1);
+    CHECK(isRejected(badFile));     // smaller than the header
+    std::filesystem::remove(badFile);
+
+    bool isWriteRejected = false;
+    try {
+        Initial::write(badFile, {M(1.0, 0.0), M(1.0, 0.1)}, {VELOCITY}, {{0, 0.0}, {1, 0.0}}, {});
+    } catch(const std::runtime_error &) {
+        isWriteRejected = true;
+    }
+    CHECK(isWriteRejected);
+}
+
+// Agents 5 and 1 after MINPERTHREAD, in different slices, are spacelike to a creator at (0.5,0)
+void testBadPositions() {
+    std::vector<M> positions;
+    std::vector<Velocity<M>> velocities(NNODES, VELOCITY);
+    std::vector<NodeState> states;
+    for(size_t i = 0; i < NNODES; ++i) {
+        bool isBad = (i == 3 * Bulk::MINPERTHREAD + 1 || i == Bulk::MINPERTHREAD + 5);
+        positions.emplace_back(1.0, isBad ? 2.0 : 0.0);
+        states.push_back({i, 0.0});
+    }
+    std::string fileName = tempFile("InitialStateTest.spacelike");
+    Initial::write(fileName, positions, velocities, states, {});
+
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Creator *creator = new Creator();
+    creator->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = creator;
+    size_t nMadeBefore = nNodesMade;
+    std::string message;
+    {
+        Initial initialState(fileName);
+        try {
+            initialState.makeAgents<Node>([](const NodeState &state) { return new Node(state); });
+        } catch(const std::runtime_error &error) {
+            message = error.what();
+        }
+    }
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    CHECK(message.find("agent " + std::to_string(Bulk::MINPERTHREAD + 5) + " ") != std::string::npos);
+    CHECK(nNodesMade == nMadeBefore);
+    std::filesystem::remove(fileName);
+}
+
+void testFailedMake(const Initial &initialState) {
+    size_t nQueuedBefore = nQueued();
+    nNodesMade = nNodesDeleted = 0;
+    failingId = BADNODE;
+    bool hasThrown = false;
+    try {
+        initialState.makeAgents<Node>([](const NodeState &state) { return new Node(state); });
+    } catch(const std::runtime_error &) {
+        hasThrown = true;
+    }
+    failingId = NNODES;
+    CHECK(hasThrown);
+    CHECK(nNodesMade >= BADNODE);
+    CHECK(nNodesDeleted == nNodesMade);
+    CHECK(nQueued() == nQueuedBefore);
+}
+
+int main() {
+    std::vector<M> positions;
+    std::vector<Velocity<M>> velocities;
+    std::vector<NodeState> states;
+    std::vector<Initial::Edge> edges;   // a ring, and a chord from each node
+    std::vector<size_t> inDegree(NNODES, 0);
+    for(size_t i = 0; i < NNODES; ++i) {
+        positions.emplace_back(1.0 + 0.25 * (i % 4), 0.1 * (i % 8));
+        velocities.push_back(i % 2 == 0 ? VELOCITY : Velocity<M>());
+        states.push_back({i, 0.5 * i});
+        edges.emplace_back(i, (i + 1) % NNODES);
+        edges.emplace_back(i, (5 * i + 2) % NNODES);
+    }
+    for(const Initial::Edge &edge : edges) ++inDegree[edge.second];
+    std::string fileName = tempFile("InitialStateTest.init");
+    Initial::write(fileName, positions, velocities, states, edges);
+
+    testBadFiles(fileName);
+    testBadPositions();
+
+    Initial initialState(fileName);
+    CHECK(initialState.nAgents() == NNODES);
+    CHECK(initialState.nEdges() == edges.size());
+    bool isSame = true;
+    for(size_t i = 0; i < NNODES; ++i) {
+        NodeState state = initialState.state(i);
+        if(!(initialState.position(i) == positions[i]) || !(initialState.velocity(i) == velocities[i]) ||
+           state.id != states[i].id || state.weight != states[i].weight) isSame = false;
+    }
+    Initial::Edges readEdges = initialState.edges();
+    CHECK(readEdges.size() == edges.size());
+    for(size_t e = 0; e < edges.size() && e < readEdges.size(); ++e) if(readEdges[e] != edges[e]) isSame = false;
+    CHECK(isSame);
+
+    testFailedMake(initialState);
+
+    std::vector<Node *> nodes = initialState.makeAgents<Node>([](const NodeState &state) { return new Node(state); });
+    CHECK(nodes.size() == NNODES);
+    bool isInPlace = true;
+    for(size_t i = 0; i < nodes.size(); ++i) {
+        if(nodes[i]->state.id != i || !(nodes[i]->position() == positions[i]) || !(nodes[i]->vel == velocities[i])) isInPlace = false;
+    }
+    CHECK(isInPlace);
+
+    std::vector<Channel<Node>> channels = initialState.makeChannels(nodes, nodes);
+    CHECK(channels.size() == edges.size());
+    bool areAttached = true;
+    for(size_t i = 0; i < NNODES; ++i) if(nodes[i]->nChannels() != inDegree[i]) areAttached = false;
+    CHECK(areAttached);
+    std::filesystem::remove(fileName);
+
+    for(size_t e = 0; e < edges.size(); ++e) nodes[edges[e].first]->out.push_back(std::move(channels[e]));
+    for(Node *node : nodes) node->callAt(2.5, [node]() { node->sendAll(); });
+
+    Simulation<Env>::start();
+    CHECK(nReceived == edges.size());
+    return testResult();
+}
@@ -0,0 +1,25 @@
+// Checks that building with LOGLEVEL=0 (as with -DLOGLEVEL=0) enables Debug messages.
+
+#define LOGLEVEL 0
+
+#include <sstream>
+
+#include "Log.h"
+#include "Testing.h"
+
+static_assert(Log::LEVEL == LogLevel::Debug);
+static_assert(Log::isEnabled<LogLevel::Debug>());
+static_assert(!Log::isEnabled<LogLevel::None>());
+
+int main() {
+    std::ostringstream captured;
+    std::streambuf *clogBuffer = std::clog.rdbuf(captured.rdbuf());
+
+    Log::write<LogLevel::Debug>("debug ", 1);
+    Log::write<LogLevel::Info>("info ", 2);
+    Log::flush();
+    CHECK(captured.str() == "DEBUG: debug 1\nINFO: info 2\n");
+
+    std::clog.rdbuf(clogBuffer);
+    return testResult();
+}
@@ -0,0 +1,45 @@
+// Checks that, at the default log level, Debug and Info messages compile to nothing, so their arguments
+// are never formatted, while warnings are buffered until Log::flush() and errors are written at once.
+
+#include <sstream>
+
+#include "Log.h"
+#include "Testing.h"
+
+static_assert(!Log::isEnabled<LogLevel::Debug>());
+static_assert(!Log::isEnabled<LogLevel::Info>());
+static_assert(Log::isEnabled<LogLevel::Warn>());
+static_assert(Log::isEnabled<LogLevel::Error>());
+static_assert(!Log::isEnabled<LogLevel::None>());
+
+int nFormatted = 0;
+
+struct Counted { };
+
+std::ostream &operator <<(std::ostream &out, const Counted &) {
+    ++nFormatted;
+    return out << "counted";
+}
+
+int main() {
+    std::ostringstream captured;
+    std::streambuf *clogBuffer = std::clog.rdbuf(captured.rdbuf());
+
+    Log::write<LogLevel::Debug>("debug ", Counted());
+    Log::write<LogLevel::Info>("info ", Counted());
+    Log::flush();
+    CHECK(nFormatted == 0);
+    CHECK(captured.str().empty());
+
+    Log::write<LogLevel::Warn>("warn ", Counted(), ' ', 1);
+    CHECK(nFormatted == 1);
+    CHECK(captured.str().empty());
+    Log::flush();
+    CHECK(captured.str() == "WARN: warn counted 1\n");
+
+    Log::write<LogLevel::Error>("error");
+    CHECK(captured.str() == "WARN: warn counted 1\nERROR: error\n");
+
+    std::clog.rdbuf(clogBuffer);
+    return testResult();
+}
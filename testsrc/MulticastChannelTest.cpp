@@ -0,0 +1,106 @@
+// Checks that every target of a MulticastChannel executes every lambda sent to it, in order, while
+// the log spans many segments, that a target that closes its end part way through stops
+// receiving, and that a target that has closed its end is no longer sent to.
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "MulticastChannel.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,60.0>, ThreadPool<4>> Env;
+
+constexpr int NREADERS = 4;
+constexpr int NSENDS = 500;
+constexpr int CLOSEAFTER = 100;     // number of lambdas the quitter executes before closing its end
+constexpr double PERIOD = 0.1;
+
+// kept outside the agents, which are deleted once their channels close
+int nReceived[NREADERS];
+bool inOrder[NREADERS] = {true, true, true, true};
+
+class Reader : public Agent<Env> {
+public:
+    int id;
+    int nextValue = 0;
+
+    Reader(int id) : id(id) { }
+
+    void receive(int value) {
+        if(value != nextValue) inOrder[id] = false;
+        nextValue = value + 1;
+        ++nReceived[id];
+        if(id == 0 && nReceived[id] == CLOSEAFTER) die();
+    }
+};
+
+class Source : public Agent<Env> {
+public:
+    MulticastChannel<Reader> out = MulticastChannel<Reader>(*this);
+    int nSent = 0;
+
+    void tick() {
+        out.send([value = nSent](Reader &reader) { reader.receive(value); });
+        if(++nSent < NSENDS) callAt(position().labTime() + PERIOD, [this]() { tick(); });
+    }
+};
+
+// Drives two readers by hand, one of which closes its end
+void testClosedTarget() {
+    Source *source = new Source();
+    source->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Reader *stayer = new Reader(1);
+    stayer->jumpTo({1.5, 0.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Reader *quitter = new Reader(2);
+    quitter->jumpTo({1.5, 0.0});
+    source->out.addTarget(*stayer);
+    source->out.addTarget(*quitter);
+
+    Simulation<Env>::currentThreadAgent = source;
+    CHECK(source->out.send([](Reader &reader) { reader.receive(0); }) == 2);
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    CHECK(quitter->getInChannel(0).executeNext(*quitter));
+    Simulation<Env>::mainThread.pCallbackBuffer->remove(quitter); // as it's stepped here instead
+    quitter->die();
+    quitter->step(); // closes the quitter's end, and deletes it
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::currentThreadAgent = source;
+    CHECK(source->out.send([](Reader &reader) { reader.receive(1); }) == 1);
+    CHECK(source->out.size() == 1);
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    CHECK(stayer->getInChannel(0).executeNext(*stayer));
+    CHECK(stayer->getInChannel(0).executeNext(*stayer));
+    CHECK(nReceived[1] == 2 && inOrder[1]);
+    CHECK(nReceived[2] == 1);
+    nReceived[1] = nReceived[2] = 0;
+    source->die();
+    stayer->die();
+}
+
+int main() {
+    testClosedTarget();
+
+    Source *source = new Source();
+    source->jumpTo({0.5, 0.0});
+    for(int i = 0; i < NREADERS; ++i) {
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        Reader *reader = new Reader(i);
+        reader->jumpTo({0.5, 2.0*i - 3.0});
+        source->out.addTarget(*reader);
+    }
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    CHECK(source->out.size() == NREADERS);
+    source->callAt(1.0, [source]() { source->tick(); });
+
+    Simulation<Env>::start();
+    CHECK(nReceived[0] == CLOSEAFTER);
+    for(int i = 1; i < NREADERS; ++i) CHECK(nReceived[i] == NSENDS);
+    for(int i = 0; i < NREADERS; ++i) CHECK(inOrder[i]);
+    return testResult();
+}
@@ -0,0 +1,61 @@
+// Checks that Numa reads the nodes of a machine from a faked two-node sysfs, where the kernel's
+// node numbers have a gap and there's a memory-only node, and that a thread pinned to a node is on it.
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "Numa.h"
+#include "Testing.h"
+
+// gives access to the topology reader
+class TestNuma : public Numa {
+public:
+    using Numa::Topology;
+    using Numa::readTopology;
+    using Numa::parseCpuList;
+};
+
+void writeNode(const std::filesystem::path &nodeDirectory, const std::string &name, const std::string &cpuList) {
+    std::filesystem::create_directories(nodeDirectory / name);
+    std::ofstream(nodeDirectory / name / "cpulist") << cpuList << "\n";
+}
+
+void testParseCpuList() {
+    CHECK(TestNuma::parseCpuList("0-3,8-9,12") == std::vector<int>({0, 1, 2, 3, 8, 9, 12}));
+    CHECK(TestNuma::parseCpuList("5") == std::vector<int>({5}));
+    CHECK(TestNuma::parseCpuList("").empty());
+}
+
+void testTwoNodes() {
+    std::filesystem::path nodeDirectory = std::filesystem::temp_directory_path() / "NumaTest";
+    std::filesystem::remove_all(nodeDirectory);
+    writeNode(nodeDirectory, "node0", "0-1,4");
+    writeNode(nodeDirectory, "node2", "2-3,5");
+    writeNode(nodeDirectory, "node3", "");         // memory only
+    std::ofstream(nodeDirectory / "possible") << "0-3\n";
+
+    std::unique_ptr<TestNuma::Topology> topology(TestNuma::readTopology(nodeDirectory));
+    std::filesystem::remove_all(nodeDirectory);
+#ifdef __linux__
+    CHECK(topology->cpus.size() == 2);
+    CHECK(topology->kernelNode == std::vector<int>({0, 2}));
+    CHECK(topology->cpus[0] == std::vector<int>({0, 1, 4}));
+    CHECK(topology->cpus[1] == std::vector<int>({2, 3, 5}));
+    CHECK(topology->nodeOfCpu == std::vector<size_t>({0, 0, 1, 1, 0, 1}));
+#else
+    CHECK(topology->cpus.size() == 1); // sysfs isn't read off Linux
+#endif
+}
+
+int main() {
+    testParseCpuList();
+    testTwoNodes();
+
+    CHECK(Numa::nNodes() >= 1);
+    CHECK(Numa::currentNode() < Numa::nNodes());
+    Numa::pinToNode(Numa::nNodes() - 1);
+    CHECK(Numa::currentNode() == Numa::nNodes() - 1);
+    return testResult();
+}
@@ -0,0 +1,117 @@
+// Checks that a NumaThreadPool runs each task on a worker of the node it was submitted to, including tasks
+// submitted by other tasks, that wait() returns once they're all done and join() stops the workers, and that
+// as a simulation's executor it steps each agent on its home node, following the agent when its home node
+// is changed while the simulation is paused.
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "ThreadPool.h"
+#include "Numa.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,5.5>, NumaThreadPool<4>> Env;
+
+constexpr int NNODES = 12;      // agents, in a ring
+constexpr int NTICKS = 10;
+
+std::thread::id mainThreadId = std::this_thread::get_id();
+std::atomic<bool> onHomeNode = true;
+std::atomic<bool> offMainThread = true;
+std::atomic<int> nTicks = 0;
+std::atomic<int> nReceived = 0;
+std::mutex nodesMutex;
+std::set<size_t> nodesUsed;
+
+// Checks that the calling lambda is run by a worker on the given node
+void checkNode(size_t node) {
+    if(Numa::currentNode() != node) onHomeNode = false;
+    if(std::this_thread::get_id() == mainThreadId) offMainThread = false;
+    std::lock_guard<std::mutex> lock(nodesMutex);
+    nodesUsed.insert(node);
+}
+
+// Each node sends to the next at every tick, so lambdas arrive from agents stepped on other nodes
+class Node : public Agent<Env> {
+public:
+    Channel<Node> next;
+
+    size_t stepNode() const { return homeNode() % Simulation<Env>::executor.nNodes(); }
+
+    void tick() {
+        checkNode(stepNode());
+        ++nTicks;
+        next.send([](Node &node) {
+            checkNode(node.stepNode());
+            ++nReceived;
+        });
+        if(position().labTime() < NTICKS) callAt(position().labTime() + 1.0, [this]() { tick(); });
+    }
+};
+
+void testPool() {
+    NumaThreadPool<3> pool;
+    CHECK(pool.nNodes() >= 1);
+    std::atomic<bool> onNode = true;
+    std::atomic<int> nRun = 0;
+    std::function<void(size_t, int)> task = [&](size_t node, int depth) {
+        if(Numa::currentNode() != node % pool.nNodes()) onNode = false;
+        ++nRun;
+        if(depth > 0) {
+            pool.submit(node + 1, [&task, node, depth]() { task(node + 1, depth - 1); });
+            pool.submit([&task, depth]() { task(Numa::currentNode(), depth - 1); }); // on this node
+        }
+    };
+    for(size_t node = 0; node < 4; ++node) pool.submit(node, [&task, node]() { task(node, 4); });
+    pool.wait();
+    CHECK(nRun == 4 * 31);
+    CHECK(onNode);
+
+    pool.submit(1, [&task]() { task(1, 0); });  // still running after wait()
+    pool.join();
+    CHECK(nRun == 4 * 31 + 1);
+    pool.join();
+    pool.wait();
+}
+
+int main() {
+    testPool();
+
+    std::vector<Node *> nodes;
+    for(int i = 0; i < NNODES; ++i) {
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        nodes.push_back(new Node());
+        nodes.back()->jumpTo({0.5, 0.0});
+        nodes.back()->setHomeNode(i);
+    }
+    for(int i = 0; i < NNODES; ++i) {
+        Node *node = nodes[i];
+        node->next = Channel<Node>(*node, *nodes[(i + 1) % NNODES]);
+        node->callAt(1.0, [node]() { node->tick(); });
+    }
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::runUntil(5.5);
+    CHECK(nTicks == 5 * NNODES);
+    for(int i = 0; i < NNODES; ++i) nodes[i]->setHomeNode(i + 1);  // no agent is running while paused
+
+    Simulation<Env>::runUntil(NTICKS + 1.5);    // lambdas arrive a lab time of 1 after they're sent
+    CHECK(nTicks == NTICKS * NNODES);
+    CHECK(nReceived == NTICKS * NNODES);
+    CHECK(onHomeNode);
+    CHECK(offMainThread);
+    CHECK(nodesUsed.size() == Simulation<Env>::executor.nNodes());
+
+    Simulation<Env>::start();
+    return testResult();
+}
@@ -0,0 +1,102 @@
+// Checks that an ObservationSink recorded into from several threads outputs, at each flush, exactly
+// the records up to the watermark, holding back those after it until a later flush, and that records
+// come out in order of lab time, then position, then record, however they were spread over the threads.
+
+#include <algorithm>
+#include <compare>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "Observations.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,0.75>, ThreadPool<4>> Env;
+
+constexpr int NAGENTS = 40;
+constexpr int NPLACES = 8;  // agents share places, so records tie on position and are ordered by the record
+
+struct Sample {
+    int id;
+    int value;
+
+    auto operator <=>(const Sample &) const = default;
+};
+
+typedef ObservationSink<Env,Sample> Sink;
+
+std::vector<Sink::Observation> output; // written on the sink's background thread, read after wait()
+
+class Recorder : public Agent<Env> {
+public:
+    Sink &  sink;
+    int     id;
+    int     nTicks = 0;
+
+    Recorder(Sink &sink, int id) : sink(sink), id(id) { }
+
+    void tick() {
+        ++nTicks;
+        sink.record({id, 2*nTicks + 1});    // recorded out of order at the same position
+        sink.record({id, 2*nTicks});
+        callAt(position().labTime() + 1.0, [this]() { tick(); });
+    }
+};
+
+// Everything the recorders record up to a lab time, in the order it should be output
+std::vector<Sink::Observation> expected(double watermark) {
+    std::vector<Sink::Observation> observations;
+    for(int tick = 1; tick <= watermark; ++tick) {
+        for(int id = 0; id < NAGENTS; ++id) {
+            M position(tick, id % NPLACES);
+            observations.push_back({position, {id, 2*tick}});
+            observations.push_back({position, {id, 2*tick + 1}});
+        }
+    }
+    std::sort(observations.begin(), observations.end(), [](const Sink::Observation &a, const Sink::Observation &b) {
+        if(a.position.labTime() != b.position.labTime()) return a.position.labTime() < b.position.labTime();
+        if(std::get<1>(a.position) != std::get<1>(b.position)) return std::get<1>(a.position) < std::get<1>(b.position);
+        return a.record < b.record;
+    });
+    return observations;
+}
+
+bool outputIs(const std::vector<Sink::Observation> &observations) {
+    if(output.size() != observations.size()) return false;
+    for(size_t i = 0; i < output.size(); ++i) {
+        if(output[i].position != observations[i].position || output[i].record != observations[i].record) return false;
+    }
+    return true;
+}
+
+int main() {
+    Sink sink([](const M &position, const Sample &record) { output.push_back({position, record}); });
+    for(int id = 0; id < NAGENTS; ++id) {
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        Recorder *recorder = new Recorder(sink, id);
+        recorder->jumpTo({0.5, double(id % NPLACES)});
+        recorder->callAt(1.0, [recorder]() { recorder->tick(); });
+    }
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::runUntil(10.5);
+    sink.flush(6.0);    // holds back ticks 7 to 10
+    sink.wait();
+    CHECK(outputIs(expected(6.0)));
+
+    Simulation<Env>::runUntil(20.5);
+    sink.flush(15.0);   // outputs the held back ticks along with 11 to 15
+    sink.wait();
+    CHECK(outputIs(expected(15.0)));
+
+    sink.flush();
+    sink.wait();
+    CHECK(outputIs(expected(20.0)));
+
+    Simulation<Env>::start();
+    return testResult();
+}
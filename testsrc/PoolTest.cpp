@@ -0,0 +1,159 @@
+// Checks that Pool blocks are aligned and reused, and that blocks released on another thread find their
+// way back, that PoolAllocator gives aligned storage to containers and shared pointers, and that
+// PooledFunction holds small targets in place and others in a block, including over-aligned ones,
+// destroying each target exactly once however the function is moved, and on whichever thread.
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Numa.h"
+#include "Pool.h"
+#include "Testing.h"
+
+std::atomic<int> nLive = 0;  // targets constructed and not yet destroyed
+
+bool isAligned(const void *block, size_t alignment) {
+    return reinterpret_cast<uintptr_t>(block) % alignment == 0;
+}
+
+// A target of a given size and alignment, that counts its instances and returns its own alignment when called
+template<size_t SIZE, size_t ALIGNMENT = alignof(int)>
+struct alignas(ALIGNMENT) Counted {
+    std::array<char, SIZE>  data{};
+    bool                    throwOnCopy = false;
+
+    Counted() { ++nLive; }
+    Counted(const Counted &other) : data(other.data) {
+        if(other.throwOnCopy) throw(std::runtime_error("copy failed"));
+        ++nLive;
+    }
+    Counted(Counted &&other) noexcept : data(other.data) { ++nLive; }
+    ~Counted() { --nLive; }
+
+    bool operator ()(int value) const { return value == 1 && isAligned(this, ALIGNMENT); }
+};
+
+typedef Counted<8>                      Small;      // held in place
+typedef Counted<100>                    Large;      // held in a Pool block
+typedef Counted<8, 2 * Pool::GRANULARITY> OverAligned;  // held in a block from the global operator new
+typedef Counted<Pool::MAXSIZE, 4 * Pool::GRANULARITY> LargeOverAligned;
+
+void testPool() {
+    std::vector<void *> blocks;
+    for(size_t size : {1, 8, 16, 24, 100, 512, 513, 4000}) {
+        void *block = Pool::allocate(size);
+        CHECK(isAligned(block, Pool::GRANULARITY));
+        blocks.push_back(block);
+    }
+    CHECK(std::set<void *>(blocks.begin(), blocks.end()).size() == blocks.size());
+    size_t i = 0;
+    for(size_t size : {1, 8, 16, 24, 100, 512, 513, 4000}) Pool::release(blocks[i++], size);
+    Pool::release(nullptr, 8);
+
+#ifndef NOPOOLS
+    void *block = Pool::allocate(24);
+    Pool::release(block, 24);
+    CHECK(Pool::allocate(24) == block);     // reused by this thread
+    Pool::release(block, 24);
+
+    // blocks released on another thread are given to the central lists when it exits, and come back from there
+    constexpr size_t SIZE = 200;    // a size class that nothing else uses
+    constexpr size_t NBLOCKS = 4 * Pool::BATCHSIZE;
+    std::vector<void *> released;
+    for(size_t j = 0; j < NBLOCKS; ++j) released.push_back(Pool::allocate(SIZE));
+    std::thread([&released]() {
+        Numa::pinToNode(0);
+        for(void *block : released) Pool::release(block, SIZE);
+    }).join();
+    std::set<void *> releasedSet(released.begin(), released.end());
+    std::vector<void *> reallocated;
+    for(size_t j = 0; j < NBLOCKS; ++j) reallocated.push_back(Pool::allocate(SIZE));
+    bool areReused = true;
+    for(void *block : reallocated) if(!releasedSet.contains(block)) areReused = false;
+    CHECK(areReused);
+    for(void *block : reallocated) Pool::release(block, SIZE);
+#endif
+}
+
+void testPoolAllocator() {
+    std::vector<int, PoolAllocator<int>> values;
+    for(int j = 0; j < 1000; ++j) values.push_back(j);
+    bool isSame = true;
+    for(int j = 0; j < 1000; ++j) if(values[j] != j) isSame = false;
+    CHECK(isSame);
+
+    std::vector<OverAligned, PoolAllocator<OverAligned>> aligned(3);
+    CHECK(isAligned(aligned.data(), alignof(OverAligned)));
+    aligned.clear();
+    aligned.shrink_to_fit();
+
+    std::shared_ptr<Large> shared = std::allocate_shared<Large>(PoolAllocator<Large>());
+    CHECK(isAligned(shared.get(), alignof(Large)));
+    shared.reset();
+    CHECK(nLive == 0);
+}
+
+template<class TARGET>
+void testPooledFunction() {
+    typedef PooledFunction<bool(int)> Function;
+    {
+        Function empty;
+        CHECK(!empty);
+
+        Function function{TARGET()};
+        CHECK(bool(function));
+        CHECK(function(1));
+        CHECK(nLive == 1);
+
+        Function moved(std::move(function));
+        CHECK(!function);
+        CHECK(moved(1));
+        CHECK(nLive == 1);
+
+        Function assigned{TARGET()};
+        CHECK(nLive == 2);
+        assigned = std::move(moved);
+        CHECK(!moved);
+        CHECK(assigned(1));
+        CHECK(nLive == 1);
+
+        std::vector<Function> functions;
+        for(int j = 0; j < 100; ++j) functions.emplace_back(TARGET()); // moved as the vector grows
+        bool areCallable = true;
+        for(const Function &f : functions) if(!f(1)) areCallable = false;
+        CHECK(areCallable);
+        CHECK(nLive == 101);
+
+        std::thread([functions = std::move(functions)]() mutable { functions.clear(); }).join(); // released on another thread
+        CHECK(nLive == 1);
+    }
+    CHECK(nLive == 0);
+
+    TARGET target;
+    target.throwOnCopy = true;
+    bool hasThrown = false;
+    try {
+        Function function(target);
+    } catch(const std::runtime_error &) {
+        hasThrown = true;
+    }
+    CHECK(hasThrown);
+    CHECK(nLive == 1);
+}
+
+int main() {
+    Numa::pinToNode(0);
+    testPool();
+    testPoolAllocator();
+    testPooledFunction<Small>();
+    testPooledFunction<Large>();
+    testPooledFunction<OverAligned>();
+    testPooledFunction<LargeOverAligned>();
+    return testResult();
+}
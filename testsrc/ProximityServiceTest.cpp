@@ -0,0 +1,102 @@
+// Checks that a ProximityService reports every approach of members on linear trajectories,
+// to both members, no earlier than it happens, once the service has heard of both members'
+// trajectories, and reports nothing else. The members are
+// spread over a wider area than the service re-tests on a trajectory change, so approaches
+// found through the spatial index are checked as well as those found by the prediction passes.
+
+#include <random>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "ProximityService.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,100.0>, ThreadPool<2>> Env;
+
+constexpr size_t    NMEMBERS = 60;
+constexpr double    DISTANCE = 1.0;
+constexpr double    HORIZON = 4.0;
+constexpr double    WIDTH = 24.0;       // members start in a square of this width about the service
+constexpr double    MAXLATENCY = 2.0 * WIDTH; // bound on how late a prediction can reach a member
+constexpr double    START = 0.5;
+
+struct Event {
+    size_t  other;
+    double  labTime;
+};
+
+std::vector<Event> events[NMEMBERS];   // written only by the member itself
+
+class Member : public Agent<Env>, public ProximityMember<Member,Env> {
+public:
+    void onProximity(size_t other) { events[proximityId()].push_back({other, position().labTime()}); }
+};
+
+int main() {
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<double> coordinate(-WIDTH/2, WIDTH/2);
+    std::uniform_real_distribution<double> velocityComponent(-0.35, 0.35);
+
+    auto *service = new ProximityService<Member,Env>(DISTANCE, HORIZON);
+    service->jumpTo({0,0,0});
+    std::vector<Member *> members;
+    std::vector<M> positions;
+    std::vector<Velocity<M>> velocities;
+    for(size_t i=0; i<NMEMBERS; ++i) {
+        Member *member = new Member();
+        member->jumpTo({0,0,0});
+        service->addMember(*member);
+        double vx = velocityComponent(random);
+        double vy = velocityComponent(random);
+        double gamma = 1.0/sqrt(1.0 - vx*vx - vy*vy);
+        positions.push_back(M(double(START), coordinate(random), coordinate(random)));
+        velocities.push_back(Velocity<M>(M(double(gamma), gamma*vx, gamma*vy)));
+        member->jumpTo(positions.back());
+        member->vel = velocities.back();
+        members.push_back(member);
+    }
+    for(Member *member : members) {
+        Simulation<Env>::currentThreadAgent = member;
+        member->trajectoryChanged();
+    }
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Simulation<Env>::start();
+
+    // every event is a real approach, reported no earlier than it happens
+    size_t nEvents = 0;
+    for(size_t i=0; i<NMEMBERS; ++i) {
+        for(const Event &event : events[i]) {
+            double expected = timeOfApproach(positions[i], velocities[i], positions[event.other], velocities[event.other], DISTANCE, START);
+            CHECK(event.labTime >= expected - 1e-9 && event.labTime <= expected + MAXLATENCY);
+            ++nEvents;
+        }
+    }
+    // Every approach after the service has heard of both trajectories, and in time to be reported
+    // before the end, is reported once to each member. A trajectory reaches the service when the
+    // member's message is absorbed, where (X-P).(X-P) = 1 for the member's start position P.
+    size_t nApproaches = 0;
+    for(size_t i=0; i<NMEMBERS; ++i) {
+        for(size_t j=0; j<NMEMBERS; ++j) {
+            if(i == j) continue;
+            double expected = timeOfApproach(positions[i], velocities[i], positions[j], velocities[j], DISTANCE, START);
+            double known = START + sqrt(1.0 + std::max(spatialNormSquared(positions[i]), spatialNormSquared(positions[j])));
+            size_t nReported = std::count_if(events[i].begin(), events[i].end(), [j](const Event &event) { return event.other == j; });
+            if(expected < known - 1e-6) {
+                CHECK(nReported == 0);
+            } else if(expected > known + 1e-6 && expected < 100.0 - MAXLATENCY) {
+                CHECK(nReported == 1);
+                ++nApproaches;
+            } else {
+                CHECK(nReported <= 1);
+            }
+        }
+    }
+    std::cout << nApproaches << " approaches, " << nEvents << " events" << std::endl;
+    CHECK(nApproaches > 0);
+    return testResult();
+}
@@ -0,0 +1,91 @@
+// Checks that a Reduction combines the values from different sources, and from the same source,
+// that are absorbed at the same point into one call to the target, and loses no values.
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "ReductionChannel.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+constexpr int NSOURCES = 10;
+constexpr int NPERTICK = 3;
+
+class Collector : public Agent<Env> {
+public:
+    void add(int value) {
+        ++nReceived;
+        total += value;
+    }
+
+    Reduction<Collector, int, &Collector::add> totals = Reduction<Collector, int, &Collector::add>(*this);
+    int     nReceived = 0;
+    long    total = 0;
+};
+
+class Source : public Agent<Env> {
+public:
+    ReductionChannel<Collector, int, &Collector::add> out;
+    long nSent = 0;
+
+    void tick() {
+        for(int i=0; i<NPERTICK; ++i) {
+            out.send(1);
+            ++nSent;
+        }
+        callAt(position().labTime() + 1.0, [this]() { tick(); });
+    }
+};
+
+// Values sent from the same point, by several sources, before the collector executes any of them.
+void testCombine() {
+    Collector *collector = new Collector();
+    collector->jumpTo({1.5, 0.0}); // where the values sent from (0.5, 0) are absorbed
+    std::vector<Source *> sources;
+    for(int i=0; i<NSOURCES; ++i) {
+        Source *source = new Source();
+        source->jumpTo({0.5, 0.0});
+        source->out = collector->totals.connect(*source);
+        Simulation<Env>::currentThreadAgent = source;
+        for(int j=0; j<NPERTICK; ++j) source->out.send(j);
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        sources.push_back(source);
+    }
+
+    std::shared_ptr<CallbackField<Env>> blockingQueue;
+    CHECK(collector->getInChannel(0).timeToNext(*collector, blockingQueue) == 0.0);
+    CHECK(blockingQueue == nullptr);
+    collector->getInChannel(0).executeNext(*collector);
+    CHECK(collector->nReceived == 1);
+    CHECK(collector->total == NSOURCES * (0 + 1 + 2));
+    collector->die();
+    for(Source *source : sources) source->die();
+}
+
+int main() {
+    testCombine();
+
+    Collector *collector = new Collector();
+    collector->jumpTo({0.5, 0.0});
+    std::vector<Source *> sources;
+    for(int i=0; i<NSOURCES; ++i) {
+        Source *source = new Source();
+        source->jumpTo({0.5, 0.0});
+        source->out = collector->totals.connect(*source);
+        source->callAt(1.0, [source]() { source->tick(); });
+        sources.push_back(source);
+    }
+    Simulation<Env>::start();
+
+    // values sent on the boundary aren't absorbed before the end
+    long nSent = -NSOURCES * NPERTICK;
+    for(Source *source : sources) nSent += source->nSent;
+    CHECK(collector->total == nSent);
+    CHECK(collector->nReceived > 0 && collector->nReceived <= nSent);
+    std::cout << collector->total << " values in " << collector->nReceived << " calls" << std::endl;
+    return testResult();
+}
@@ -0,0 +1,40 @@
+// Checks that an agent blocked on the stub of a RemoteReference is released when the
+// reference is dropped without being attached to a source, so it runs on to the boundary.
+
+#include <memory>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+bool reachedEnd = false; // kept outside the target, which is deleted once its channels close
+
+class Target : public Agent<Env> {
+};
+
+class Holder : public Agent<Env> {
+public:
+    Channel<Target>                             out;
+    std::unique_ptr<RemoteReference<Target>>    reference;
+};
+
+int main() {
+    Target *target = new Target();
+    target->jumpTo({0.5, 0.0});
+    target->callAt(15.0, []() { reachedEnd = true; });
+    Holder *holder = new Holder();
+    holder->jumpTo({0.5, 0.0});
+    holder->out = Channel<Target>(*holder, *target);
+    // The target attaches the reference's channel at about time 2 and then blocks on its stub
+    holder->callAt(1.0, [holder]() { holder->reference = std::make_unique<RemoteReference<Target>>(holder->out.target()); });
+    holder->callAt(10.0, [holder]() { holder->reference.reset(); });
+    Simulation<Env>::start();
+    CHECK(reachedEnd);
+    return testResult();
+}
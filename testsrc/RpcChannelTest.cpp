@@ -0,0 +1,93 @@
+// Checks that an RpcChannel returns the result of each request to its continuation, in order, that
+// requests returning void have their continuation called, that every call is replied to down the same
+// reply channel, and that a coroutine of the caller can co_await a call.
+
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "RpcChannel.h"
+#include "Coroutine.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+// kept outside the agents, which are deleted once their channels close
+std::vector<int> replies;
+std::vector<double> replyTimes;
+std::vector<size_t> replyChannelCounts;
+int nVoidReplies = 0;
+std::vector<int> awaitedReplies;
+bool awaitedVoidReply = false;
+bool taskFinished = false;
+
+class Target : public Agent<Env> {
+public:
+    int nRequests = 0;
+};
+
+class Caller : public Agent<Env>, public CoroutineFrames {
+public:
+    RpcChannel<Target,Caller> rpc;
+
+    void recordReply(int result) {
+        replies.push_back(result);
+        replyTimes.push_back(position().labTime());
+        replyChannelCounts.push_back(nChannels());
+    }
+
+    AgentTask awaitCalls() {
+        awaitedReplies.push_back(co_await rpc.call([](Target &target) { return ++target.nRequests; }));
+        co_await rpc.call([](Target &target) { target.nRequests += 10; });
+        awaitedVoidReply = true;
+        awaitedReplies.push_back(co_await rpc.call([](Target &target) { return ++target.nRequests; }));
+        taskFinished = true;
+        die();
+    }
+};
+
+typedef RpcChannel<Target,Caller> Rpc;
+
+int main() {
+    CHECK(!Rpc().isOpen());
+    CHECK(!Rpc().call([](Target &) { return 0; }, [](Caller &, int) { }));
+
+    Target *target = new Target();
+    target->jumpTo({0.5, 1.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Caller *caller = new Caller();
+    caller->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    caller->rpc = Rpc(*caller, *target);
+    CHECK(caller->rpc.isOpen());
+    CHECK(caller->nChannels() == 1);  // the reply channel
+    CHECK(target->nChannels() == 1);  // the request channel
+
+    Simulation<Env>::currentThreadAgent = caller;
+    for(int i = 0; i < 3; ++i) {
+        CHECK(caller->rpc.call([](Target &target) { return ++target.nRequests; },
+                               [](Caller &caller, int result) { caller.recordReply(result); }));
+    }
+    CHECK(caller->rpc.call([](Target &target) { target.nRequests += 10; },
+                           [](Caller &caller) {
+                               ++nVoidReplies;
+                               caller.awaitCalls();
+                           }));
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    CHECK(caller->nChannels() == 1);  // calls don't make new channels
+    CHECK(target->nChannels() == 1);
+
+    Simulation<Env>::start();
+    CHECK((replies == std::vector<int>{1, 2, 3}));
+    CHECK((replyChannelCounts == std::vector<size_t>{1, 1, 1}));
+    for(size_t i = 1; i < replyTimes.size(); ++i) CHECK(replyTimes[i] >= replyTimes[i-1]);
+    CHECK(nVoidReplies == 1);
+    CHECK((awaitedReplies == std::vector<int>{14, 25}));
+    CHECK(awaitedVoidReply);
+    CHECK(taskFinished);
+    return testResult();
+}
@@ -0,0 +1,76 @@
+// Checks that agents that run only on timers, including an AgentPopulation, and agents with
+// nothing to do are kept, rather than deleted, when the simulation pauses at the boundary
+// of runUntil(), and carry on when it resumes.
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "AgentPopulation.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,5.0>, ThreadPool<2>> Env;
+
+int nTicks = 0;
+int nMemberSteps = 0;
+int nReceived = 0;
+
+class Ticker : public Agent<Env> {
+public:
+    void tick() {
+        ++nTicks;
+        callAt(position().labTime() + 1.0, [this]() { tick(); });
+    }
+};
+
+class Members : public AgentPopulation<Members, Env> {
+public:
+    void stepMembers(std::span<const size_t> readyMembers) {
+        for(size_t member : readyMembers) {
+            ++nMemberSteps;
+            wakeAt(member, position().labTime() + 1.0);
+        }
+    }
+};
+
+class Idle : public Agent<Env> {
+public:
+    void receive() { ++nReceived; }
+};
+
+class Sender : public Agent<Env> {
+public:
+    Channel<Idle> out;
+};
+
+int main() {
+    Ticker *ticker = new Ticker();
+    ticker->jumpTo({0.5, 0.0});
+    ticker->callAt(1.0, [ticker]() { ticker->tick(); });
+    Members *members = new Members();
+    members->jumpTo({0.5, 0.0});
+    members->wakeAt(members->addMember(M(0.5, 0.0), Velocity<M>()), 1.0);
+    Idle *idle = new Idle();
+    idle->jumpTo({0.5, 1.0});
+
+    Simulation<Env>::runUntil(5.5); // ticks at 1..5
+    CHECK(nTicks == 5);
+    CHECK(nMemberSteps == 5);
+
+    // a channel attached to the idle agent while the simulation is paused
+    Sender *sender = new Sender();
+    sender->jumpTo({6.0, 0.0});
+    sender->out = Channel<Idle>(*sender, *idle);
+    Simulation<Env>::currentThreadAgent = sender;
+    sender->out.send([](Idle &idle) { idle.receive(); });
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::runUntil(10.5);
+    CHECK(nTicks == 10);
+    CHECK(nMemberSteps == 10);
+    CHECK(nReceived == 1);
+    Simulation<Env>::start();
+    return testResult();
+}
@@ -0,0 +1,73 @@
+// Checks that a lambda field with a minimum reaction time, ShiftedField<InnerProdField<M,1.0>,2.0>,
+// delivers lambdas where (X-P-R).(X-P-R) = 1 for the point of emission P and R = (2,0), and that a
+// ShiftedField can't be made with a shift outside the future light-cone.
+
+#include <cmath>
+#include <stdexcept>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "ShiftedField.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ShiftedField<InnerProdField<M,1.0>,2.0> ReactionField;
+typedef ForwardSimulation<M, ReactionField, LabTimeBoundary<M,10.0>, ThreadPool<2>> Env;
+
+double nearReceivedAt = -1.0; // kept outside the receivers, which are deleted once their channels close
+double farReceivedAt = -1.0;
+
+class Receiver : public Agent<Env> {
+public:
+    double *receivedAt;
+
+    Receiver(double &receivedAt) : receivedAt(&receivedAt) { }
+};
+
+class Sender : public Agent<Env> {
+public:
+    Channel<Receiver> near;
+    Channel<Receiver> far;
+};
+
+bool throwsOnShift(M shift) {
+    try {
+        ReactionField field(shift);
+    } catch(const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    CHECK(Simulation<Env>::lambdaField.shift() == M(2.0, 0.0));
+    CHECK((ShiftedField<InnerProdField<M,1.0>>().shift() == M(0.0, 0.0)));
+    CHECK(!throwsOnShift(M(0.0, 0.0)));
+    CHECK(!throwsOnShift(M(2.0, 1.0)));
+    CHECK(!throwsOnShift(M(1.0, 1.0)));   // on the light-cone
+    CHECK(throwsOnShift(M(1.0, 3.0)));    // spacelike
+    CHECK(throwsOnShift(M(-2.0, 0.0)));   // past light-cone
+
+    Receiver *near = new Receiver(nearReceivedAt);
+    near->jumpTo({0.5, 0.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Receiver *far = new Receiver(farReceivedAt);
+    far->jumpTo({0.5, 2.0});
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    Sender *sender = new Sender();
+    sender->jumpTo({0.5, 0.0});
+    sender->near = Channel<Receiver>(*sender, *near);
+    sender->far = Channel<Receiver>(*sender, *far);
+    Simulation<Env>::currentThreadAgent = sender;
+    sender->near.send([](Receiver &receiver) { *receiver.receivedAt = receiver.position().labTime(); });
+    sender->far.send([](Receiver &receiver) { *receiver.receivedAt = receiver.position().labTime(); });
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::start();
+    CHECK(std::fabs(nearReceivedAt - 3.5) < 1e-9);              // (t - 2.5)^2 = 1
+    CHECK(std::fabs(farReceivedAt - (2.5 + sqrt(5.0))) < 1e-9);  // (t - 2.5)^2 - 2^2 = 1
+    return testResult();
+}
@@ -0,0 +1,108 @@
+// Checks that Snapshots captures every followed agent on every cut, at the cut, with the state it had
+// then, that the files hold every capture once flushed while the simulation is paused, and that
+// destroying the Snapshots while agents are still followed cancels their captures.
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "Snapshots.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,0.75>, ThreadPool<4>> Env;
+
+constexpr int NWALKERS = 500;
+constexpr double FIRSTCUT = 1.0;
+constexpr double INTERVAL = 1.0;
+constexpr uint64_t NCUTS = 20;      // cuts at lab times 1..20 before the first pause
+constexpr double FIRSTSTEP = 0.55;  // walkers step at FIRSTSTEP + STEP*k, never on a cut
+constexpr double STEP = 0.3;
+
+class Walker : public Agent<Env> {
+public:
+    int id;
+    int nSteps = 0;
+
+    Walker(int id) : id(id) { }
+
+    void walk() {
+        ++nSteps;
+        callAt(position().labTime() + STEP, [this]() { walk(); });
+    }
+};
+
+double cutTime(uint64_t cut) { return FIRSTCUT + INTERVAL * cut; }
+
+// number of steps a walker has taken before a lab time
+int stepsBefore(double labTime) {
+    return static_cast<int>(std::ceil((labTime - FIRSTSTEP) / STEP));
+}
+
+struct Counts {
+    size_t              nRecords = 0;
+    std::vector<int>    nCaptures = std::vector<int>(NWALKERS * NCUTS, 0); // by walker and cut
+    bool                isConsistent = true;
+};
+
+Counts readBack(const std::vector<std::string> &files) {
+    Counts counts;
+    for(const std::string &file : files) {
+        Snapshots<Env>::forEachRecord(file, [&](uint64_t cut, const M &position, SnapshotPayload &payload) {
+            int id = payload.read<int>();
+            int nSteps = payload.read<int>();
+            ++counts.nRecords;
+            if(cut >= NCUTS || id < 0 || id >= NWALKERS || payload.remaining() != 0) {
+                counts.isConsistent = false;
+                return;
+            }
+            ++counts.nCaptures[id * NCUTS + cut];
+            if(std::fabs(position.labTime() - cutTime(cut)) > 1e-9) counts.isConsistent = false;
+            if(std::get<1>(position) != id) counts.isConsistent = false;
+            if(nSteps != stepsBefore(cutTime(cut))) counts.isConsistent = false;
+        });
+    }
+    return counts;
+}
+
+int main() {
+    std::string prefix = (std::filesystem::temp_directory_path() / "SnapshotsTest").string();
+    Snapshots<Env> *snapshots = new Snapshots<Env>(prefix, FIRSTCUT, INTERVAL);
+    CHECK(snapshots->cutTime(NCUTS) == cutTime(NCUTS));
+    for(int i = 0; i < NWALKERS; ++i) {
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        Walker *walker = new Walker(i);
+        walker->jumpTo({0.5, double(i)});
+        walker->callAt(FIRSTSTEP, [walker]() { walker->walk(); });
+        snapshots->follow(*walker, [](const Walker &walker, SnapshotRecord &record) {
+            record.write(walker.id);
+            record.write(walker.nSteps);
+        });
+    }
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::runUntil(NCUTS + 0.5);
+    snapshots->flush();
+    std::vector<std::string> files = snapshots->files();
+    CHECK(!files.empty());
+    Counts counts = readBack(files);
+    CHECK(counts.nRecords == NWALKERS * NCUTS);
+    CHECK(counts.isConsistent);
+    for(int n : counts.nCaptures) CHECK(n == 1);
+
+    // the walkers are still followed, so their remaining captures are cancelled
+    delete snapshots;
+    Simulation<Env>::runUntil(NCUTS + 5.5);
+    CHECK(readBack(files).nRecords == NWALKERS * NCUTS);
+
+    Simulation<Env>::start();
+    for(const std::string &file : files) std::remove(file.c_str());
+    return testResult();
+}
@@ -0,0 +1,97 @@
+// Checks that the agents left at the end of a simulation are all deleted: those that opt in with
+// hasThreadSafeDestructor() in parallel, when there are enough of them, while closing their channels
+// to each other, and the rest in turn on the main thread.
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,2.0>, ThreadPool<2>> Env;
+
+// Runs the teardown that would otherwise happen at exit, when the main thread's agent is destroyed,
+// so that it can be checked.
+class Teardown : public CallbackQueue<Env> {
+public:
+    static constexpr size_t CHUNK = CallbackQueue<Env>::TEARDOWNCHUNK;
+
+    static void run() {
+        void (CallbackQueue<Env>::*deleteCallbackAgents)() = &Teardown::deleteCallbackAgents;
+        (Simulation<Env>::mainThread.getCallbackField().get()->*deleteCallbackAgents)();
+    }
+};
+
+constexpr size_t NPARTICLES = 4 * Teardown::CHUNK;
+constexpr size_t NLONERS = 10;
+
+std::atomic<size_t> nParticlesDeleted = 0;
+std::atomic<size_t> nLonersDeleted = 0;
+std::atomic<bool> lonersOnMainThread = true;
+std::thread::id mainThreadId = std::this_thread::get_id();
+std::mutex threadsMutex;
+std::set<std::thread::id> particleThreads;
+
+// Each particle has a channel to the next, in a ring, so they're all still alive at the boundary
+class Particle : public Agent<Env> {
+public:
+    Channel<Particle> next;
+
+    ~Particle() {
+        ++nParticlesDeleted;
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        particleThreads.insert(std::this_thread::get_id());
+    }
+
+    bool hasThreadSafeDestructor() const override { return true; } // closing a channel is thread safe
+};
+
+// has a timer beyond the boundary, so it's still alive at the boundary
+class Loner : public Agent<Env> {
+public:
+    ~Loner() {
+        ++nLonersDeleted;
+        if(std::this_thread::get_id() != mainThreadId) lonersOnMainThread = false;
+    }
+};
+
+int main() {
+    std::vector<Particle *> particles;
+    for(size_t i = 0; i < NPARTICLES; ++i) {
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        particles.push_back(new Particle());
+        particles.back()->jumpTo({0.5, double(i)});
+    }
+    for(size_t i = 0; i < NPARTICLES; ++i) {
+        particles[i]->next = Channel<Particle>(*particles[i], *particles[(i + 1) % NPARTICLES]);
+    }
+    for(size_t i = 0; i < NLONERS; ++i) {
+        Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+        Loner *loner = new Loner();
+        loner->jumpTo({0.5, -1.0 - i});
+        loner->callAt(10.0, []() { });
+    }
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+
+    Simulation<Env>::start();
+    CHECK(nParticlesDeleted == 0);
+    CHECK(nLonersDeleted == 0);
+
+    Teardown::run();
+    CHECK(nParticlesDeleted == NPARTICLES);
+    CHECK(nLonersDeleted == NLONERS);
+    CHECK(lonersOnMainThread);
+    if(std::thread::hardware_concurrency() > 1) {
+        CHECK(particleThreads.size() > 1);
+        CHECK(!particleThreads.contains(mainThreadId));
+    }
+    return testResult();
+}
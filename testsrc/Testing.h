@@ -0,0 +1,25 @@
+#ifndef TESTING_H
+#define TESTING_H
+
+#include <iostream>
+
+// Minimal checks for the test programs in this directory (see the Makefile's test target).
+// A failed CHECK is reported but doesn't stop the test, and main() should return testResult().
+
+inline int nFailedChecks = 0;
+
+inline void check(bool passed, const char *condition, const char *file, int line) {
+    if(!passed) {
+        std::cerr << file << ":" << line << ": check failed: " << condition << std::endl;
+        ++nFailedChecks;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+inline int testResult() {
+    if(nFailedChecks != 0) std::cerr << nFailedChecks << " checks failed" << std::endl;
+    return nFailedChecks == 0 ? 0 : 1;
+}
+
+#endif
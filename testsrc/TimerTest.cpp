@@ -0,0 +1,67 @@
+// Checks that an agent driven only by timers, with no inChannels, is kept while it has
+// timers, including at the end of the simulation, that timers at the same lab time are called in the order they were set, and that
+// the agent is deleted once it has no timers left.
+
+#include <stdexcept>
+#include <vector>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,10.0>, ThreadPool<2>> Env;
+
+int nTicks = 0;
+std::vector<int> calls;
+bool tickerDeleted = false;
+bool countdownDeleted = false;
+
+class Ticker : public Agent<Env> {
+public:
+    ~Ticker() { tickerDeleted = true; }
+
+    void tick() {
+        ++nTicks;
+        callAt(position().labTime() + 1.0, [this]() { tick(); });
+    }
+};
+
+// Sets its timers once, then has nothing more to do
+class Countdown : public Agent<Env> {
+public:
+    ~Countdown() { countdownDeleted = true; }
+
+    void setTimers() {
+        callAt(3.0, [this]() { calls.push_back(3); });
+        callAt(2.0, [this]() { calls.push_back(1); });
+        callAt(2.0, [this]() { calls.push_back(2); });
+    }
+};
+
+int main() {
+    Ticker *ticker = new Ticker();
+    ticker->jumpTo({0.5, 0.0});
+    ticker->callAt(1.0, [ticker]() { ticker->tick(); });
+
+    Countdown *countdown = new Countdown();
+    countdown->jumpTo({0.5, 1.0});
+    countdown->setTimers();
+    bool threw = false;
+    try {
+        countdown->callAt(0.25, []() { });
+    } catch(const std::runtime_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    Simulation<Env>::start();
+    CHECK(nTicks == 10); // at lab times 1 to 10, as a timer is called before blocking on the boundary at the same time
+    CHECK(!tickerDeleted); // it has a timer beyond the boundary, so is kept until the end
+    CHECK(calls == std::vector<int>({1, 2, 3}));
+    CHECK(countdownDeleted);
+    return testResult();
+}
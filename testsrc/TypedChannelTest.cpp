@@ -0,0 +1,95 @@
+// Checks that a TypedChannel delivers messages of each of its types in the order they were sent,
+// and times sending and executing small messages over a TypedChannel against a Channel.
+// The number of messages to time can be given on the command line: for a meaningful comparison,
+// build with optimisation, e.g.
+//     g++ -O2 -std=c++20 -Isrc testsrc/TypedChannelTest.cpp -pthread -latomic && ./a.out 1000000
+
+#include <chrono>
+#include <cstdlib>
+
+#include "ForwardSimulation.h"
+#include "Agent.h"
+#include "Simulation.h"
+#include "MinkowskiSpace.h"
+#include "InnerProdField.h"
+#include "TypedChannel.h"
+#include "Testing.h"
+
+typedef MinkowskiSpace<double,double> M;
+typedef ForwardSimulation<M, InnerProdField<M,1.0>, LabTimeBoundary<M,20.0>, ThreadPool<2>> Env;
+
+class Counter : public Agent<Env> {
+public:
+    long total = 0;
+};
+
+struct Add {
+    int x;
+    void operator()(Counter &counter) const { counter.total += x; }
+};
+
+struct Double {
+    void operator()(Counter &counter) const { counter.total *= 2; }
+};
+
+class Sender : public Agent<Env> {
+public:
+    TypedChannel<Counter, Add, Double>  typedOut;
+    Channel<Counter>                    out;
+};
+
+// Executes everything sent to the counter so far, as the counter would in the simulation.
+void executeAll(Counter &counter) {
+    while(counter.getInChannel(0).executeNext(counter)) { }
+}
+
+// Sends nMessages with send(i) and returns the seconds taken to send and execute them.
+template<class SEND>
+double timeMessages(Sender &sender, Counter &counter, long nMessages, SEND send) {
+    auto start = std::chrono::steady_clock::now();
+    Simulation<Env>::currentThreadAgent = &sender;
+    for(long i = 0; i < nMessages; ++i) send(i);
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    executeAll(counter);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    long nMessages = (argc > 1 ? std::atol(argv[1]) : 10000);
+
+    Counter *typedCounter = new Counter();
+    Counter *counter = new Counter();
+    Sender *sender = new Sender();
+    typedCounter->jumpTo({1.5, 0.0});
+    counter->jumpTo({1.5, 0.0});
+    sender->jumpTo({0.5, 0.0});
+    sender->typedOut = TypedChannel<Counter, Add, Double>(*sender, *typedCounter);
+    sender->out = Channel<Counter>(*sender, *counter);
+
+    // messages of different types are executed in order: ((1*2)+3)*2 + 4
+    Simulation<Env>::currentThreadAgent = sender;
+    CHECK(sender->typedOut.send(Add{1}));
+    CHECK(sender->typedOut.send(Double{}));
+    CHECK(sender->typedOut.send(Add{3}));
+    CHECK(sender->typedOut.send(Double{}));
+    CHECK(sender->typedOut.send(Add{4}));
+    Simulation<Env>::currentThreadAgent = &Simulation<Env>::mainThread;
+    executeAll(*typedCounter);
+    CHECK(typedCounter->total == 14);
+
+    typedCounter->total = 0;
+    double typedSeconds = timeMessages(*sender, *typedCounter, nMessages, [sender](long i) {
+        sender->typedOut.send(Add{int(i & 1)});
+    });
+    double seconds = timeMessages(*sender, *counter, nMessages, [sender](long i) {
+        sender->out.send([x = int(i & 1)](Counter &counter) { counter.total += x; });
+    });
+    CHECK(typedCounter->total == nMessages/2);
+    CHECK(counter->total == nMessages/2);
+    std::cout << nMessages << " messages: " << seconds << "s with Channel, " << typedSeconds << "s with TypedChannel" << std::endl;
+
+    typedCounter->die();
+    counter->die();
+    sender->die();
+    return testResult();
+}